@@ -6,28 +6,50 @@
 #include <iostream>
 
 TermStructureHoLee::TermStructureHoLee(TermStructure* fitted_term, const int& n, const int& i, const double& delta, const double& pi)
-    : initial_term_(fitted_term), n_(n), i_(i), delta_(delta), pi_(pi) {}
+    : initial_term_(fitted_term), n_(n), i_(i), delta_(delta), pi_(pi),
+      log_h_table_(std::make_shared<HoLeeLogHTable>(delta, pi)) {}
+
+TermStructureHoLee::TermStructureHoLee(TermStructure* fitted_term, const int& n, const int& i, const double& delta, const double& pi,
+                                       const std::shared_ptr<HoLeeLogHTable>& log_h_table)
+    : initial_term_(fitted_term), n_(n), i_(i), delta_(delta), pi_(pi), log_h_table_(log_h_table) {}
 
 inline double hT(const double& T, const double& delta, const double& pi) {
     return (1.0 / (pi + (1 - pi) * pow(delta, T)));
 }
 
-double TermStructureHoLee::d(const double& T) const {
-    double d = initial_term_->d(T + n_) / initial_term_->d(n_);
+HoLeeLogHTable::HoLeeLogHTable(const double& delta, const double& pi)
+    : delta_(delta), pi_(pi), log_delta_(log(delta)) {}
 
+double HoLeeLogHTable::logH(const double& x) const {
+    return log(hT(x, delta_, pi_));
+}
 
-    for (int j = 1; j < n_; ++j) {
-        double hT1 = hT(T + (n_ - j), delta_, pi_);
-        double hT2 = hT(n_ - j, delta_, pi_);
-        d *= hT1 / hT2;
-
+double HoLeeLogHTable::sum(const double& frac, const int& m) {
+    if (m <= 0) return 0.0;
+    std::vector<double>& row = sums_[frac];
+    if (row.empty()) row.push_back(0.0);
+    while (int(row.size()) <= m) {
+        int k = int(row.size());
+        row.push_back(row.back() + logH(frac + k));
     }
+    return row[m];
+}
 
-    double hT_final = hT(n_, delta_, pi_);
-    double pow_delta = pow(delta_, T * (n_ - i_));
-    d *= hT_final * pow_delta;
+double HoLeeLogHTable::logNodeFactor(const int& n, const int& i, const double& T) {
+    // prod_{j=1}^{n-1} h(T + n - j) / h(n - j) = exp(S_frac(w + n - 1) - S_frac(w) - S_0(n - 1)), T = w + frac
+    double log_factor = logH(n);
+    if (n > 1) {
+        int w = int(floor(T));
+        double frac = T - w;
+        log_factor += sum(frac, w + n - 1) - sum(frac, w) - sum(0.0, n - 1);
+    }
+    if (n != i) log_factor += T * (n - i) * log_delta_;
+    return log_factor;
+}
 
-    return d;
+double TermStructureHoLee::d(const double& T) const {
+    double d = initial_term_->d(T + n_) / initial_term_->d(n_);
+    return d * exp(log_h_table_->logNodeFactor(n_, i_, T));
 }
 
 std::vector<std::vector<TermStructureHoLee>> buildTermStructureTree(TermStructure* initial, 
@@ -35,11 +57,12 @@ std::vector<std::vector<TermStructureHoLee>> buildTermStructureTree(TermStructur
                                                                     const double& delta, 
                                                                     const double& pi) {
     std::vector<std::vector<TermStructureHoLee>> hl_tree;
+    std::shared_ptr<HoLeeLogHTable> log_h_table = std::make_shared<HoLeeLogHTable>(delta, pi);
 
     for (int t = 0; t < no_steps; ++t) {
         hl_tree.push_back(std::vector<TermStructureHoLee>());
         for (int j = 0; j <= t; ++j) {
-            TermStructureHoLee hl(initial, t, j, delta, pi); 
+            TermStructureHoLee hl(initial, t, j, delta, pi, log_h_table); 
             hl_tree[t].push_back(hl);
         }
     }
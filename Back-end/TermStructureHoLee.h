@@ -4,6 +4,25 @@
 
 #include "TermStructure.h"
 #include <vector>
+#include <map>
+#include <memory>
+
+// Prefix sums of log h(x) = -log(pi + (1 - pi) * delta^x) for one (delta, pi) pair.
+// Rows are keyed by the fractional part of the maturity and grown on demand, so a
+// node discount factor needs a couple of lookups and one exp instead of an O(n) loop.
+// Not safe for concurrent use; every tree shares one table per thread.
+class HoLeeLogHTable {
+private:
+    double delta_;
+    double pi_;
+    double log_delta_;
+    std::map<double, std::vector<double>> sums_; // sums_[frac][m] = sum_{k=1}^{m} log h(frac + k)
+public:
+    HoLeeLogHTable(const double& delta, const double& pi);
+    double logH(const double& x) const;
+    double sum(const double& frac, const int& m); // sum_{k=1}^{m} log h(frac + k)
+    double logNodeFactor(const int& n, const int& i, const double& T); // log of d(T) / (D(T + n) / D(n))
+};
 
 class TermStructureHoLee : public TermStructure {
 private:
@@ -12,8 +31,11 @@ private:
     int i_; //statue i
     double delta_;
     double pi_; // Implied Binomial Probabilit
+    std::shared_ptr<HoLeeLogHTable> log_h_table_; // shared by nodes of the same tree
 public:
     TermStructureHoLee(TermStructure* fitted_term, const int& n, const int& i, const double& delta, const double& pi);
+    TermStructureHoLee(TermStructure* fitted_term, const int& n, const int& i, const double& delta, const double& pi,
+                       const std::shared_ptr<HoLeeLogHTable>& log_h_table);
 
     virtual double r(const double& t) const override { return 0.0; } // Not implemented
     virtual double d(const double& T) const override;
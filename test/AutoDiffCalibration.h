@@ -0,0 +1,66 @@
+//AutoDiffCalibration.h
+#ifndef AUTO_DIFF_CALIBRATION_H
+#define AUTO_DIFF_CALIBRATION_H
+
+#include <vector>
+#include "Eigen/Dense"
+#include "unsupported/Eigen/AutoDiff"
+#include "unsupported/Eigen/NonLinearOptimization"
+
+// Levenberg-Marquardt calibration for models whose residuals are written once, generically over
+// the scalar type. A model provides
+//     static const int max_parameters;
+//     int values() const;
+//     template <class Scalar> void residuals(const Scalar* x, const int& parameters, Scalar* fvec) const;
+// The Jacobian is the exact derivative of residuals(), obtained by running it on AutoDiffScalar
+// values carrying one derivative slot per parameter. The slots have a fixed maximum size, so the
+// evaluation does not allocate per operation.
+template <class Model>
+class AutoDiffCalibrationFunctor {
+public:
+    typedef Eigen::Matrix<double, Eigen::Dynamic, 1, 0, Model::max_parameters, 1> Derivatives;
+    typedef Eigen::AutoDiffScalar<Derivatives> ADScalar;
+
+private:
+    const Model& model_;
+    int parameters_;
+    mutable std::vector<ADScalar> ad_x_;
+    mutable std::vector<ADScalar> ad_fvec_;
+public:
+    AutoDiffCalibrationFunctor(const Model& model, const int& parameters)
+        : model_(model), parameters_(parameters), ad_x_(parameters), ad_fvec_(model.values()) {}
+
+    int operator()(const Eigen::VectorXd& x, Eigen::VectorXd& fvec) const {
+        model_.residuals(x.data(), parameters_, fvec.data());
+        return 0;
+    }
+
+    int df(const Eigen::VectorXd& x, Eigen::MatrixXd& fjac) const {
+        for (int j = 0; j < parameters_; ++j) {
+            ad_x_[j] = ADScalar(x[j], parameters_, j);
+        }
+        model_.residuals(ad_x_.data(), parameters_, ad_fvec_.data());
+        for (int k = 0; k < values(); ++k) {
+            fjac.row(k) = ad_fvec_[k].derivatives().transpose();
+        }
+        return 0;
+    }
+
+    int inputs() const { return parameters_; }
+    int values() const { return model_.values(); }
+};
+
+// Minimizes the model's residuals from the starting point x, which receives the solution.
+// Returns the Eigen::LevenbergMarquardtSpace::Status of the solve.
+template <class Model>
+int calibrateAutoDiff(const Model& model, Eigen::VectorXd& x,
+                      const double& ftol, const double& xtol, const int& maxfev) {
+    AutoDiffCalibrationFunctor<Model> functor(model, int(x.size()));
+    Eigen::LevenbergMarquardt<AutoDiffCalibrationFunctor<Model>> lm(functor);
+    lm.parameters.ftol = ftol;
+    lm.parameters.xtol = xtol;
+    lm.parameters.maxfev = maxfev;
+    return lm.minimize(x);
+}
+
+#endif // AUTO_DIFF_CALIBRATION_H
@@ -0,0 +1,195 @@
+//CurveStore.cpp
+#include "CurveStore.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char kStoreMagic[8] = { 'C', 'U', 'R', 'V', 'S', 'T', 'O', '1' };
+
+struct StoreHeader {
+    char magic[8];
+    uint32_t no_dates;
+    uint32_t reserved;
+    uint64_t no_points;
+};
+
+// Column offsets in bytes; dates are padded so the 8-byte columns stay aligned
+size_t datesOffset() { return sizeof(StoreHeader); }
+size_t offsetsOffset(const uint32_t& no_dates) { return (datesOffset() + 4 * size_t(no_dates) + 7) / 8 * 8; }
+size_t daysOffset(const uint32_t& no_dates) { return offsetsOffset(no_dates) + 8 * (size_t(no_dates) + 1); }
+size_t ratesOffset(const uint32_t& no_dates, const uint64_t& no_points) { return daysOffset(no_dates) + 8 * no_points; }
+
+struct CurvePoint {
+    int32_t date;
+    double days;
+    double rate;
+};
+
+}
+
+CurveStore::CurveStore()
+    : data_(nullptr), size_(0), no_dates_(0), dates_(nullptr), offsets_(nullptr), days_(nullptr), rates_(nullptr) {}
+
+CurveStore::~CurveStore() {
+    close();
+}
+
+int CurveStore::parseDate(const std::string& date) {
+    int year, month, day;
+    if (sscanf(date.c_str(), "%d-%d-%d", &year, &month, &day) != 3) return 0;
+    return year * 10000 + month * 100 + day;
+}
+
+bool CurveStore::build(const std::string& csv_filename, const std::string& store_filename) {
+    std::ifstream file(csv_filename);
+    if (!file.is_open()) {
+        std::cerr << "Unable to open file " << csv_filename << std::endl;
+        return false;
+    }
+
+    std::vector<CurvePoint> points;
+    std::string line;
+    // Skip the header
+    std::getline(file, line);
+    while (std::getline(file, line)) {
+        std::stringstream ss(line);
+        std::string date, days, rate;
+        if (!std::getline(ss, date, ',') || !std::getline(ss, days, ',') || !std::getline(ss, rate, ',')) continue;
+        if (rate == "Same") continue;
+        CurvePoint point = { parseDate(date), std::stod(days), std::stod(rate) };
+        points.push_back(point);
+    }
+    std::stable_sort(points.begin(), points.end(),
+                     [](const CurvePoint& a, const CurvePoint& b) { return a.date < b.date; });
+
+    std::vector<int32_t> dates;
+    std::vector<uint64_t> offsets;
+    for (size_t k = 0; k < points.size(); ++k) {
+        if (dates.empty() || points[k].date != dates.back()) {
+            dates.push_back(points[k].date);
+            offsets.push_back(k);
+        }
+    }
+    offsets.push_back(points.size());
+
+    StoreHeader header;
+    std::memcpy(header.magic, kStoreMagic, sizeof(kStoreMagic));
+    header.no_dates = uint32_t(dates.size());
+    header.reserved = 0;
+    header.no_points = points.size();
+
+    std::vector<char> out(ratesOffset(header.no_dates, header.no_points) + 8 * points.size(), 0);
+    std::memcpy(&out[0], &header, sizeof(header));
+    if (!dates.empty()) std::memcpy(&out[datesOffset()], dates.data(), 4 * dates.size());
+    std::memcpy(&out[offsetsOffset(header.no_dates)], offsets.data(), 8 * offsets.size());
+    double* days = reinterpret_cast<double*>(&out[daysOffset(header.no_dates)]);
+    double* rates = reinterpret_cast<double*>(&out[ratesOffset(header.no_dates, header.no_points)]);
+    for (size_t k = 0; k < points.size(); ++k) {
+        days[k] = points[k].days;
+        rates[k] = points[k].rate;
+    }
+
+    std::ofstream store(store_filename, std::ios::binary);
+    if (!store.is_open()) {
+        std::cerr << "Unable to write file " << store_filename << std::endl;
+        return false;
+    }
+    store.write(out.data(), out.size());
+    return bool(store);
+}
+
+bool CurveStore::stale(const std::string& csv_filename, const std::string& store_filename) {
+    struct stat csv, store;
+    if (stat(store_filename.c_str(), &store) != 0) return true;
+    if (stat(csv_filename.c_str(), &csv) != 0) return false; // nothing to rebuild it from
+    return csv.st_mtime > store.st_mtime;
+}
+
+bool CurveStore::open(const std::string& filename, const std::string& csv_filename) {
+    if (!stale(csv_filename, filename) && open(filename)) return true;
+    if (!build(csv_filename, filename)) return false;
+    return open(filename);
+}
+
+bool CurveStore::open(const std::string& filename) {
+    close();
+#ifndef _WIN32
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < off_t(sizeof(StoreHeader))) {
+        ::close(fd);
+        return false;
+    }
+    void* mapping = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) return false;
+    data_ = static_cast<const char*>(mapping);
+    size_ = size_t(st.st_size);
+#else
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) return false;
+    buffer_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (buffer_.size() < sizeof(StoreHeader)) {
+        buffer_.clear();
+        return false;
+    }
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+#endif
+
+    StoreHeader header;
+    std::memcpy(&header, data_, sizeof(header));
+    if (std::memcmp(header.magic, kStoreMagic, sizeof(kStoreMagic)) != 0 ||
+        size_ < ratesOffset(header.no_dates, header.no_points) + 8 * header.no_points) {
+        std::cerr << "Invalid curve store " << filename << std::endl;
+        close();
+        return false;
+    }
+
+    no_dates_ = header.no_dates;
+    dates_ = reinterpret_cast<const int32_t*>(data_ + datesOffset());
+    offsets_ = reinterpret_cast<const uint64_t*>(data_ + offsetsOffset(no_dates_));
+    days_ = reinterpret_cast<const double*>(data_ + daysOffset(no_dates_));
+    rates_ = reinterpret_cast<const double*>(data_ + ratesOffset(no_dates_, header.no_points));
+    return true;
+}
+
+void CurveStore::close() {
+#ifndef _WIN32
+    if (data_ != nullptr) munmap(const_cast<char*>(data_), size_);
+#endif
+    buffer_.clear();
+    data_ = nullptr;
+    size_ = 0;
+    no_dates_ = 0;
+    dates_ = nullptr;
+    offsets_ = nullptr;
+    days_ = nullptr;
+    rates_ = nullptr;
+}
+
+bool CurveStore::find(const int& as_of, size_t& k) const {
+    const int32_t* it = std::upper_bound(dates_, dates_ + no_dates_, as_of);
+    if (it == dates_) return false;
+    k = size_t(it - dates_) - 1;
+    return true;
+}
+
+double cubicKnotDays(const double& days) {
+    double months = std::round(days * 12.0 / 365.0 * 1000.0) / 1000.0;
+    return months * 365.0 / 12.0;
+}
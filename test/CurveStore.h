@@ -0,0 +1,51 @@
+//CurveStore.h
+#ifndef CURVE_STORE_H
+#define CURVE_STORE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Read-only archive of every observation date in cubic.csv, memory-mapped by the server.
+// Columnar layout after a fixed header: sorted dates (yyyymmdd), per-date offsets into the
+// point columns, then all maturities in days and all rates. Built with CurveStore::build, and
+// again whenever cubic.csv is modified after it.
+class CurveStore {
+private:
+    const char* data_;
+    size_t size_;
+    std::vector<char> buffer_; // used instead of a mapping where mmap is unavailable
+    uint32_t no_dates_;
+    const int32_t* dates_;
+    const uint64_t* offsets_;
+    const double* days_;
+    const double* rates_;
+    CurveStore(const CurveStore&) = delete;
+    CurveStore& operator=(const CurveStore&) = delete;
+public:
+    CurveStore();
+    ~CurveStore();
+
+    static bool build(const std::string& csv_filename, const std::string& store_filename);
+    static bool stale(const std::string& csv_filename, const std::string& store_filename); // missing or older than the csv
+    static int parseDate(const std::string& date); // "YYYY-MM-DD" -> yyyymmdd, 0 if malformed
+
+    bool open(const std::string& filename);
+    // Opens filename, rebuilding it from csv_filename first when it is stale or cannot be opened
+    bool open(const std::string& filename, const std::string& csv_filename);
+    void close();
+    bool isOpen() const { return data_ != nullptr; }
+
+    size_t size() const { return no_dates_; } // number of observation dates
+    int date(const size_t& k) const { return dates_[k]; }
+    bool find(const int& as_of, size_t& k) const; // latest observation on or before as_of
+    size_t points(const size_t& k) const { return size_t(offsets_[k + 1] - offsets_[k]); }
+    const double* days(const size_t& k) const { return days_ + offsets_[k]; }
+    const double* rates(const size_t& k) const { return rates_ + offsets_[k]; }
+};
+
+// Knot maturity in days as cubic.py fits it: months rounded to 3 decimals
+double cubicKnotDays(const double& days);
+
+#endif // CURVE_STORE_H
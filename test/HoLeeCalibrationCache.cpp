@@ -0,0 +1,118 @@
+//HoLeeCalibrationCache.cpp
+#include "HoLeeCalibrationCache.h"
+#include "TermStructureHoLee.h"
+#include <cstring>
+#include <tuple>
+
+bool HoLeeCalibrationCache::Key::operator<(const Key& other) const {
+    return std::tie(curve, n, i, dt, delta, pi, ftol, xtol, maxfev)
+         < std::tie(other.curve, other.n, other.i, other.dt, other.delta, other.pi, other.ftol, other.xtol, other.maxfev);
+}
+
+HoLeeCalibrationCache::HoLeeCalibrationCache(const size_t& max_curves)
+    : max_curves_(max_curves > 0 ? max_curves : 1), clock_(0) {}
+
+// FNV-1a over the raw bytes of both vectors
+uint64_t HoLeeCalibrationCache::fingerprint(const std::vector<double>& market_times, const std::vector<double>& market_prices) {
+    uint64_t hash = 14695981039346656037ULL;
+    const std::vector<double>* columns[] = { &market_times, &market_prices };
+    for (const std::vector<double>* column : columns) {
+        uint64_t size = column->size();
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&size);
+        for (size_t b = 0; b < sizeof(size); ++b) hash = (hash ^ bytes[b]) * 1099511628211ULL;
+        bytes = reinterpret_cast<const unsigned char*>(column->data());
+        for (size_t b = 0; b < column->size() * sizeof(double); ++b) hash = (hash ^ bytes[b]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+HoLeeCalibrationCache::Key HoLeeCalibrationCache::makeKey(const TermStructureHoLee& model, const uint64_t& curve,
+                                                          const HoLeeCalibrationSettings& settings) {
+    Key key = { curve, model.n_, model.i_, model.dt_, model.delta_, model.pi_, settings.ftol, settings.xtol, settings.maxfev };
+    return key;
+}
+
+bool HoLeeCalibrationCache::lookup(const Key& key, double& delta, double& pi, HoLeeCalibrationReport& report) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto curve = curves_.find(key.curve);
+    if (curve == curves_.end()) return false;
+    curve->second.last_used = ++clock_;
+    auto entry = curve->second.results.find(key);
+    if (entry == curve->second.results.end()) return false;
+    delta = entry->second.delta;
+    pi = entry->second.pi;
+    report = entry->second.report;
+    return true;
+}
+
+void HoLeeCalibrationCache::store(const Key& key, const double& delta, const double& pi,
+                                  const HoLeeCalibrationReport& report) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto curve = curves_.find(key.curve);
+    if (curve == curves_.end()) {
+        // A new curve replaces the least recently used one
+        if (curves_.size() >= max_curves_) {
+            auto oldest = curves_.begin();
+            for (auto it = curves_.begin(); it != curves_.end(); ++it) {
+                if (it->second.last_used < oldest->second.last_used) oldest = it;
+            }
+            curves_.erase(oldest);
+        }
+        curve = curves_.insert(std::make_pair(key.curve, CurveEntries())).first;
+    }
+    curve->second.last_used = ++clock_;
+    Calibration& entry = curve->second.results[key];
+    entry.delta = delta;
+    entry.pi = pi;
+    entry.report = report;
+}
+
+void HoLeeCalibrationCache::evictCurve(const uint64_t& curve) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    curves_.erase(curve);
+}
+
+void HoLeeCalibrationCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    curves_.clear();
+}
+
+size_t HoLeeCalibrationCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t entries = 0;
+    for (const auto& curve : curves_) entries += curve.second.results.size();
+    return entries;
+}
+
+bool HoLeeCalibrationCache::calibrate(TermStructureHoLee& model,
+                                      const std::vector<double>& market_times,
+                                      const std::vector<double>& market_prices,
+                                      const HoLeeCalibrationSettings& settings) {
+    HoLeeCalibrationReport report;
+    return calibrate(model, market_times, market_prices, settings, report);
+}
+
+bool HoLeeCalibrationCache::calibrate(TermStructureHoLee& model,
+                                      const std::vector<double>& market_times,
+                                      const std::vector<double>& market_prices,
+                                      const HoLeeCalibrationSettings& settings,
+                                      HoLeeCalibrationReport& report) {
+    Key key = makeKey(model, fingerprint(market_times, market_prices), settings);
+    double delta, pi;
+    if (lookup(key, delta, pi, report)) {
+        model.delta_ = delta;
+        model.pi_ = pi;
+        report.iterations = 0;
+        report.nfev = 0;
+        report.njev = 0;
+        report.setup_ms = 0.0;
+        report.solve_ms = 0.0;
+        report.cached = true;
+        return true;
+    }
+    // Solved outside the lock; concurrent misses on the same key both solve and store the same result.
+    // Solves that did not converge are not kept, so the next request tries again.
+    model.calibrate(market_times, market_prices, settings, report);
+    if (report.converged()) store(key, model.delta_, model.pi_, report);
+    return false;
+}
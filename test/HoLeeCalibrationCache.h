@@ -0,0 +1,73 @@
+//HoLeeCalibrationCache.h
+#ifndef HO_LEE_CALIBRATION_CACHE_H
+#define HO_LEE_CALIBRATION_CACHE_H
+
+#include "TermStructureHoLee.h"
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// Thread-safe cache of calibrated Ho-Lee parameters. Entries are grouped by a fingerprint of the
+// calibration curve (market times and prices); when more than max_curves curves are in use the
+// least recently used curve is replaced and all of its entries are evicted. Since the fingerprint
+// covers the curve's contents, a curve that changes gets a new fingerprint and can never hit the
+// old entries; these age out through the LRU, or at once through evictCurve.
+class HoLeeCalibrationCache {
+public:
+    struct Key {
+        uint64_t curve; // fingerprint of market times and prices
+        int n;
+        int i;
+        double dt;
+        double delta; // starting point of the solve
+        double pi;
+        double ftol;
+        double xtol;
+        int maxfev;
+
+        bool operator<(const Key& other) const;
+    };
+
+private:
+    struct Calibration {
+        double delta;
+        double pi;
+        HoLeeCalibrationReport report; // of the solve that produced the entry
+    };
+    struct CurveEntries {
+        uint64_t last_used;
+        std::map<Key, Calibration> results;
+    };
+
+    mutable std::mutex mutex_;
+    size_t max_curves_;
+    uint64_t clock_;
+    std::map<uint64_t, CurveEntries> curves_;
+public:
+    explicit HoLeeCalibrationCache(const size_t& max_curves = 4);
+
+    static uint64_t fingerprint(const std::vector<double>& market_times, const std::vector<double>& market_prices);
+    static Key makeKey(const TermStructureHoLee& model, const uint64_t& curve, const HoLeeCalibrationSettings& settings);
+
+    bool lookup(const Key& key, double& delta, double& pi, HoLeeCalibrationReport& report);
+    void store(const Key& key, const double& delta, const double& pi, const HoLeeCalibrationReport& report);
+    void evictCurve(const uint64_t& curve);
+    void clear();
+    size_t size() const; // number of cached calibrations
+
+    // TermStructureHoLee::calibrate, skipped when the same calibration has already been solved.
+    // On a hit the report keeps the stored status and residual norm, with no evaluations or time
+    // spent, and cached set; returns whether it was a hit. Only converged solves are stored.
+    bool calibrate(TermStructureHoLee& model,
+                   const std::vector<double>& market_times,
+                   const std::vector<double>& market_prices,
+                   const HoLeeCalibrationSettings& settings);
+    bool calibrate(TermStructureHoLee& model,
+                   const std::vector<double>& market_times,
+                   const std::vector<double>& market_prices,
+                   const HoLeeCalibrationSettings& settings,
+                   HoLeeCalibrationReport& report);
+};
+
+#endif // HO_LEE_CALIBRATION_CACHE_H
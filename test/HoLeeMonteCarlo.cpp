@@ -0,0 +1,104 @@
+//HoLeeMonteCarlo.cpp
+#include "HoLeeMonteCarlo.h"
+#include <cmath>
+
+HoLeeMonteCarloSettings::HoLeeMonteCarloSettings()
+    : paths(1000000), seed(1), antithetic(true), control_variate(true), threads(1), pool(nullptr) {}
+
+HoLeeMonteCarloResult::HoLeeMonteCarloResult()
+    : price(0.0), standard_error(0.0), paths(0), control_price(0.0), control_beta(0.0), simulation_ms(0.0) {}
+
+HoLeeMonteCarloMoments::HoLeeMonteCarloMoments()
+    : count(0), mean_y(0.0), mean_x(0.0), m_yy(0.0), m_xx(0.0), m_xy(0.0) {}
+
+// Pairwise update of Chan, Golub and LeVeque, so the pooled moments do not lose the variance to
+// cancellation the way raw sums of squares would over millions of samples
+void HoLeeMonteCarloMoments::add(const HoLeeMonteCarloMoments& other) {
+    if (other.count == 0) return;
+    long long total = count + other.count;
+    double dy = other.mean_y - mean_y;
+    double dx = other.mean_x - mean_x;
+    double scale = double(count) * double(other.count) / double(total);
+    m_yy += other.m_yy + dy * dy * scale;
+    m_xx += other.m_xx + dx * dx * scale;
+    m_xy += other.m_xy + dx * dy * scale;
+    mean_y += dy * double(other.count) / double(total);
+    mean_x += dx * double(other.count) / double(total);
+    count = total;
+}
+
+HoLeeMonteCarlo::HoLeeMonteCarlo() : steps_(0), pi_(0.0) {}
+
+// Every path of the block starts at node (0, 0) and takes one step across all of them at a time;
+// the loops over paths have no branches so they vectorize. The twin of an antithetic pair draws
+// 1 - u where its partner drew u.
+void HoLeeMonteCarlo::simulateBlock(const uint64_t& seed, const long long& first, const bool& antithetic,
+                                    Block& block) const {
+    const int count = block.count;
+    block.keys.resize(count);
+    block.nodes.resize(size_t(steps_ + 1) * count);
+    block.discounts.resize(size_t(steps_ + 1) * count);
+    block.values.resize(count);
+    for (int p = 0; p < count; ++p) {
+        block.keys[p] = hoLeePathKey(seed, uint64_t(first + p));
+        block.nodes[p] = 0;
+        block.discounts[p] = 1.0;
+    }
+    const double* delta_powers = delta_powers_.data();
+    for (int t = 0; t < steps_; ++t) {
+        const int* nodes = block.nodes.data() + size_t(t) * count;
+        const double* discounts = block.discounts.data() + size_t(t) * count;
+        int* next_nodes = block.nodes.data() + size_t(t + 1) * count;
+        double* next_discounts = block.discounts.data() + size_t(t + 1) * count;
+        const double step_factor = step_factors_[t];
+        for (int p = 0; p < count; ++p) {
+            double u = hoLeeUniform(block.keys[p], t);
+            if (antithetic) u = 1.0 - u;
+            next_discounts[p] = discounts[p] * step_factor * delta_powers[t - nodes[p]];
+            next_nodes[p] = nodes[p] + int(u < pi_);
+        }
+    }
+}
+
+// Two passes over the block's samples: means, then centered moments
+HoLeeMonteCarloMoments HoLeeMonteCarlo::blockMoments(const Block& block) const {
+    HoLeeMonteCarloMoments moments;
+    moments.count = block.count;
+    if (block.count == 0) return moments;
+    for (int p = 0; p < block.count; ++p) {
+        moments.mean_y += block.samples[p];
+        moments.mean_x += block.controls[p];
+    }
+    moments.mean_y /= block.count;
+    moments.mean_x /= block.count;
+    for (int p = 0; p < block.count; ++p) {
+        double y = block.samples[p] - moments.mean_y;
+        double x = block.controls[p] - moments.mean_x;
+        moments.m_yy += y * y;
+        moments.m_xx += x * x;
+        moments.m_xy += x * y;
+    }
+    return moments;
+}
+
+// Pools the blocks in order and applies the control: price = mean Y - beta (mean X - control_price)
+// with beta = cov(X, Y) / var(X), the weight that minimizes the variance of the estimate
+HoLeeMonteCarloResult HoLeeMonteCarlo::estimate(const std::vector<HoLeeMonteCarloMoments>& moments,
+                                                const double& control_price,
+                                                const HoLeeMonteCarloSettings& settings) const {
+    HoLeeMonteCarloMoments pooled;
+    for (const HoLeeMonteCarloMoments& block : moments) pooled.add(block);
+
+    HoLeeMonteCarloResult result;
+    result.paths = settings.antithetic ? 2 * pooled.count : pooled.count;
+    if (pooled.count == 0) return result;
+    double beta = pooled.m_xx > 0.0 ? pooled.m_xy / pooled.m_xx : 0.0;
+    result.control_price = control_price;
+    result.control_beta = beta;
+    result.price = pooled.mean_y - beta * (pooled.mean_x - control_price);
+    if (pooled.count > 1) {
+        double residual = std::max(0.0, pooled.m_yy - beta * pooled.m_xy); // sum of (Y - beta X)^2, centered
+        result.standard_error = std::sqrt(residual / double(pooled.count - 1) / double(pooled.count));
+    }
+    return result;
+}
@@ -0,0 +1,179 @@
+//HoLeeMonteCarlo.h
+#ifndef HO_LEE_MONTE_CARLO_H
+#define HO_LEE_MONTE_CARLO_H
+
+#include "TermStructureHoLee.h"
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include "unsupported/Eigen/CXX11/ThreadPool"
+
+struct HoLeeMonteCarloSettings {
+    long long paths; // simulated paths, rounded up to whole antithetic pairs
+    uint64_t seed;
+    bool antithetic; // each path is paired with one drawing 1 - u wherever it drew u
+    bool control_variate;
+    int threads;
+    Eigen::ThreadPool* pool; // long-lived, owned by the caller; a pool is started per simulation when null
+
+    HoLeeMonteCarloSettings();
+};
+
+struct HoLeeMonteCarloResult {
+    double price;
+    double standard_error;
+    long long paths;
+    double control_price; // exact lattice value of the control
+    double control_beta; // weight of the control in the estimate, 0 without one
+    double simulation_ms;
+
+    HoLeeMonteCarloResult();
+};
+
+// Mean and centered second moments of the samples of one block, for the estimate Y - beta (X - E X)
+struct HoLeeMonteCarloMoments {
+    long long count;
+    double mean_y;
+    double mean_x;
+    double m_yy;
+    double m_xx;
+    double m_xy;
+
+    HoLeeMonteCarloMoments();
+    void add(const HoLeeMonteCarloMoments& other); // pools the two blocks' samples
+};
+
+// Uniform in [0, 1) as a pure function of (seed, path, step), so every path draws the same numbers
+// whichever thread or block simulates it. path_key is hoLeePathKey(seed, path), hashed once per path.
+inline uint64_t hoLeeMix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+inline uint64_t hoLeePathKey(const uint64_t& seed, const uint64_t& path) {
+    return hoLeeMix(seed + path * 0x9E3779B97F4A7C15ULL);
+}
+inline double hoLeeUniform(const uint64_t& path_key, const int& step) {
+    return double(hoLeeMix(path_key + uint64_t(step + 1) * 0x9E3779B97F4A7C15ULL) >> 11) * (1.0 / 9007199254740992.0); // 53 bits
+}
+
+// Monte Carlo over the Ho-Lee lattice dynamics: from node (t, i) a path moves to node (t + 1, i + 1)
+// with probability pi and to (t + 1, i) otherwise, and is discounted by d(t, i, dt) = a_t delta^(t - i)
+// over the step. Paths carry the whole history of their nodes, so products that depend on the route
+// taken, which the recombining lattice cannot value, are priced from the same dynamics.
+//
+// Samples are simulated in fixed blocks of paths_per_block, step by step across the block's paths.
+// Blocks are spread over a thread pool and their moments pooled in block order, so the result for
+// a given seed is identical bit for bit for every thread count.
+class HoLeeMonteCarlo {
+public:
+    static const int paths_per_block = 256;
+
+    // Block storage: nodes and discounts of path p at step t in [t * count + p]
+    struct Block {
+        int count;
+        std::vector<uint64_t> keys;
+        std::vector<int> nodes;
+        std::vector<double> discounts; // from today to the step
+        std::vector<double> values; // product's discounted payoffs
+        std::vector<double> samples; // per sample, antithetic pairs averaged
+        std::vector<double> controls;
+    };
+private:
+    int steps_;
+    double pi_;
+    std::vector<double> step_factors_;
+    std::vector<double> delta_powers_;
+
+    void simulateBlock(const uint64_t& seed, const long long& first, const bool& antithetic, Block& block) const;
+    HoLeeMonteCarloMoments blockMoments(const Block& block) const;
+    HoLeeMonteCarloResult estimate(const std::vector<HoLeeMonteCarloMoments>& moments, const double& control_price,
+                                   const HoLeeMonteCarloSettings& settings) const;
+public:
+    HoLeeMonteCarlo();
+    // Steps 0..lattice.steps() - 1 of the lattice, paths branching with probability pi
+    template <class Curve>
+    void reset(const HoLeeLattice<Curve>& lattice, const double& pi);
+
+    int steps() const { return steps_; }
+
+    // Payoff is called once per block of simulated paths as
+    //     void operator()(const int& count, const int* nodes, const double* discounts, double* values) const
+    // and writes each path's payoff discounted to today into values[p]. With control_variate set,
+    // control_payoffs[i] is the payoff of the control at node (steps(), i) and control_price its
+    // value on the lattice; the control is discounted along the same path and weighted by the
+    // regression of the product on it across all samples.
+    template <class Payoff>
+    HoLeeMonteCarloResult simulate(const Payoff& payoff, const std::vector<double>& control_payoffs,
+                                   const double& control_price, const HoLeeMonteCarloSettings& settings) const;
+};
+
+template <class Curve>
+void HoLeeMonteCarlo::reset(const HoLeeLattice<Curve>& lattice, const double& pi) {
+    steps_ = lattice.steps() - 1;
+    pi_ = pi;
+    step_factors_.resize(lattice.steps());
+    for (int t = 0; t < lattice.steps(); ++t) step_factors_[t] = lattice.stepFactor(t);
+    delta_powers_.assign(lattice.deltaPowers(), lattice.deltaPowers() + lattice.steps());
+}
+
+template <class Payoff>
+HoLeeMonteCarloResult HoLeeMonteCarlo::simulate(const Payoff& payoff, const std::vector<double>& control_payoffs,
+                                                const double& control_price,
+                                                const HoLeeMonteCarloSettings& settings) const {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const bool control = settings.control_variate && int(control_payoffs.size()) > steps_;
+    const long long samples = settings.antithetic ? (settings.paths + 1) / 2 : settings.paths;
+    const long long blocks = (samples + paths_per_block - 1) / paths_per_block;
+    std::vector<HoLeeMonteCarloMoments> moments(blocks);
+
+    auto run = [&](const long long& b, Block& block) {
+        long long first = b * paths_per_block;
+        block.count = int(std::min<long long>(paths_per_block, samples - first));
+        block.samples.assign(block.count, 0.0);
+        block.controls.assign(block.count, 0.0);
+        const double weight = settings.antithetic ? 0.5 : 1.0;
+        for (int twin = 0; twin < (settings.antithetic ? 2 : 1); ++twin) {
+            simulateBlock(settings.seed, first, twin == 1, block);
+            payoff(block.count, block.nodes.data(), block.discounts.data(), block.values.data());
+            const int* expiry_nodes = block.nodes.data() + size_t(steps_) * block.count;
+            const double* expiry_discounts = block.discounts.data() + size_t(steps_) * block.count;
+            for (int p = 0; p < block.count; ++p) {
+                block.samples[p] += weight * block.values[p];
+                if (control) block.controls[p] += weight * expiry_discounts[p] * control_payoffs[expiry_nodes[p]];
+            }
+        }
+        moments[b] = blockMoments(block);
+    };
+
+    int workers = int(std::min<long long>(std::max(1, settings.threads), blocks));
+    if (workers <= 1) {
+        Block block;
+        for (long long b = 0; b < blocks; ++b) run(b, block);
+    } else {
+        // Worker w takes blocks w, w + workers, ...; every block writes its own moments
+        std::unique_ptr<Eigen::ThreadPool> owned_pool;
+        Eigen::ThreadPool* pool = settings.pool;
+        if (!pool) {
+            owned_pool.reset(new Eigen::ThreadPool(workers));
+            pool = owned_pool.get();
+        }
+        Eigen::Barrier done(workers);
+        for (int w = 0; w < workers; ++w) {
+            pool->Schedule([&, w]() {
+                Block block;
+                for (long long b = w; b < blocks; b += workers) run(b, block);
+                done.Notify();
+            });
+        }
+        done.Wait();
+    }
+
+    HoLeeMonteCarloResult result = estimate(moments, control_price, settings);
+    result.simulation_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+#endif // HO_LEE_MONTE_CARLO_H
@@ -1,6 +1,19 @@
 #include "TermStructure.h"
 #include <cmath>
 #include <algorithm>
+#include <limits>
+#include "Eigen/Dense"
+
+typedef Eigen::Map<const Eigen::ArrayXd> ConstArrayMap;
+typedef Eigen::Map<Eigen::ArrayXd> ArrayMap;
+
+void TermStructure::r(const double* t, double* out, const size_t& n) const {
+    for (size_t k = 0; k < n; ++k) out[k] = r(t[k]);
+}
+
+void TermStructure::d(const double* t, double* out, const size_t& n) const {
+    for (size_t k = 0; k < n; ++k) out[k] = d(t[k]);
+}
 
 double TermStructure::yieldFromDiscountFactor(const double& d_t, const double& t) {
     return (-std::log(d_t) / t);
@@ -30,30 +43,99 @@ double TermStructure::nelsonSiegelDiscountFactor(double t, const NelsonSiegelPar
     return exp(-spotRate * t);
 }
 
+void TermStructure::nelsonSiegelSpotRates(const double* t, double* out, const size_t& n, const NelsonSiegelParams& params) {
+    ConstArrayMap x(t, n);
+    Eigen::ArrayXd scaled = x / params.tau;
+    Eigen::ArrayXd decay = (-scaled).exp();
+    Eigen::ArrayXd loading = (1 - decay) / scaled;
+    ArrayMap(out, n) = params.beta0 + params.beta1 * loading + params.beta2 * (loading - decay);
+}
+
+void TermStructure::nelsonSiegelDiscountFactors(const double* t, double* out, const size_t& n, const NelsonSiegelParams& params) {
+    nelsonSiegelSpotRates(t, out, n, params);
+    ArrayMap rates(out, n);
+    rates = (-rates * ConstArrayMap(t, n)).exp();
+}
+
+// Safeguarded Newton solve of sum_k flows[k] * exp(-r * times[k]) = target for the spot rate r.
+// The left side is strictly decreasing in r, so a bracket is grown from the guess and any Newton
+// step leaving it is replaced by bisection. Returns NaN when no rate reprices the bond.
+static double solveSpotRate(const std::vector<double>& times, const std::vector<double>& flows,
+                            const double& target, const double& guess) {
+    auto residual = [&](const double& r, double& slope) {
+        double value = -target;
+        slope = 0.0;
+        for (size_t k = 0; k < times.size(); ++k) {
+            double pv = flows[k] * std::exp(-r * times[k]);
+            value += pv;
+            slope -= times[k] * pv;
+        }
+        return value;
+    };
+
+    double slope;
+    double lo = guess, hi = guess, step = 0.01;
+    double f_lo = residual(lo, slope), f_hi = f_lo;
+    for (int k = 0; f_lo < 0.0 && k < 64; ++k, step *= 2.0) f_lo = residual(lo -= step, slope);
+    for (int k = 0; f_hi > 0.0 && k < 64; ++k, step *= 2.0) f_hi = residual(hi += step, slope);
+    if (f_lo < 0.0 || f_hi > 0.0) return std::numeric_limits<double>::quiet_NaN();
+
+    double r = guess;
+    for (int iteration = 0; iteration < 100; ++iteration) {
+        double value = residual(r, slope);
+        if (std::abs(value) <= 1e-12 * std::abs(target)) break;
+        if (value > 0.0) lo = r; else hi = r;
+
+        double next = r - value / slope;
+        if (!(next > lo && next < hi)) next = 0.5 * (lo + hi);
+        if (std::abs(next - r) <= 1e-15 * (1.0 + std::abs(r))) {
+            r = next;
+            break;
+        }
+        r = next;
+    }
+    return r;
+}
+
 std::vector<double> TermStructure::bootstrapYieldCurve(const std::vector<Bond>& bonds) {
+    std::vector<double> discountFactors;
+    return bootstrapYieldCurve(bonds, discountFactors);
+}
+
+// Bonds are ordered by maturity, one per coupon period. discountFactors holds the discount
+// factor at the maturity of each bond solved so far and is extended in place, so a batch that
+// only appends instruments reuses the earlier solutions instead of solving them again.
+std::vector<double> TermStructure::bootstrapYieldCurve(const std::vector<Bond>& bonds, std::vector<double>& discountFactors) {
     std::vector<double> spotRates(bonds.size(), 0.0);
-    for (size_t i = 0; i < bonds.size(); ++i) {
+    size_t solved = std::min(discountFactors.size(), bonds.size());
+    for (size_t i = 0; i < solved; ++i) {
+        spotRates[i] = yieldFromDiscountFactor(discountFactors[i], bonds[i].maturity);
+    }
+    discountFactors.resize(solved);
+
+    std::vector<double> times, flows;
+    for (size_t i = solved; i < bonds.size(); ++i) {
         const auto& bond = bonds[i];
         double cashFlowSum = 0.0;
         double coupon = bond.couponRate * bond.faceValue / bond.frequency;
+        times.clear();
+        flows.clear();
         for (int j = 1; j <= bond.maturity * bond.frequency; ++j) {
             double time = j / static_cast<double>(bond.frequency);
-            double df = j - 1 < i ? discountFactorFromYield(spotRates[j - 1], time) : 1.0;  // Use previously bootstrapped rates
-            cashFlowSum += coupon * df;
+            if (size_t(j - 1) < i) {
+                cashFlowSum += coupon * discountFactors[j - 1];  // Use previously bootstrapped discount factors
+            } else {
+                times.push_back(time);  // Discounted at the spot rate being solved for
+                flows.push_back(coupon);
+            }
         }
         // Add the face value payment
-        double lastDF = discountFactorFromYield(spotRates[i], bond.maturity);
-        double totalValue = cashFlowSum + bond.faceValue * lastDF;
-        double targetPrice = bond.price;
-
-        // Simple solver: Adjust the spot rate until the bond is correctly priced
-        double error = totalValue - targetPrice;
-        while (std::abs(error) > 0.0001) {
-            spotRates[i] += (targetPrice - totalValue) / 100000.0;  // Adjust rate
-            lastDF = discountFactorFromYield(spotRates[i], bond.maturity);
-            totalValue = cashFlowSum + bond.faceValue * lastDF;
-            error = totalValue - targetPrice;
-        }
+        times.push_back(bond.maturity);
+        flows.push_back(bond.faceValue);
+
+        double guess = i > 0 ? spotRates[i - 1] : 0.0;
+        spotRates[i] = solveSpotRate(times, flows, bond.price - cashFlowSum, guess);
+        discountFactors.push_back(discountFactorFromYield(spotRates[i], bond.maturity));
     }
     return spotRates;
 }
@@ -79,6 +161,15 @@ double TermStructureFlat::f(const double& t1, const double& t2) const {
     return forwardRateFromDiscountFactors(d1, d2, t2 - t1);
 }
 
+void TermStructureFlat::r(const double* t, double* out, const size_t& n) const {
+    ConstArrayMap x(t, n);
+    ArrayMap(out, n) = (x >= 0).select(Eigen::ArrayXd::Constant(n, R_), 0.0);
+}
+
+void TermStructureFlat::d(const double* t, double* out, const size_t& n) const {
+    ArrayMap(out, n) = (-R_ * ConstArrayMap(t, n)).exp();
+}
+
 void TermStructureFlat::setIntRate(const double& r) {
     R_ = r;
 }
@@ -101,12 +192,18 @@ TermStructureInterpolated::~TermStructureInterpolated() {
 TermStructureInterpolated::TermStructureInterpolated(const TermStructureInterpolated& other) {
     times_ = other.times_;
     yields_ = other.yields_;
+    uniform_ = other.uniform_;
+    inv_step_ = other.inv_step_;
+    knots_ = other.knots_;
 }
 
 TermStructureInterpolated& TermStructureInterpolated::operator=(const TermStructureInterpolated& other) {
     if (this != &other) {
         times_ = other.times_;
         yields_ = other.yields_;
+        uniform_ = other.uniform_;
+        inv_step_ = other.inv_step_;
+        knots_ = other.knots_;
     }
     return *this;
 }
@@ -115,6 +212,15 @@ double TermStructureInterpolated::r(const double& T) const {
     // Implementing linear interpolation for simplicity
     if (times_.empty()) return 0.0;
 
+    if (uniform_) {
+        if (T <= knots_[0]) return knots_[1];
+        double pos = (T - knots_[0]) * inv_step_;
+        if (pos >= double(times_.size() - 1)) return knots_.back();
+
+        const double* knot = &knots_[2 * size_t(pos)]; // t1, y1, t2, y2
+        return knot[1] + (T - knot[0]) * (knot[3] - knot[1]) / (knot[2] - knot[0]);
+    }
+
     auto it = std::lower_bound(times_.begin(), times_.end(), T);
     if (it == times_.begin()) return yields_.front();
     if (it == times_.end()) return yields_.back();
@@ -139,17 +245,70 @@ double TermStructureInterpolated::f(const double& t1, const double& t2) const {
     return forwardRateFromDiscountFactors(d1, d2, t2 - t1);
 }
 
+void TermStructureInterpolated::r(const double* t, double* out, const size_t& n) const {
+    for (size_t k = 0; k < n; ++k) out[k] = TermStructureInterpolated::r(t[k]);
+}
+
+void TermStructureInterpolated::d(const double* t, double* out, const size_t& n) const {
+    TermStructureInterpolated::r(t, out, n);
+    ArrayMap yields(out, n);
+    yields = (-yields * ConstArrayMap(t, n)).exp();
+}
+
+void TermStructureInterpolated::dAdjoint(const double& t, const double& d_bar, double* yields_bar) const {
+    if (times_.empty()) return;
+    // d = exp(-r t), r = (1 - w) y1 + w y2 inside the knots and flat outside them
+    double r_bar = -t * d(t) * d_bar;
+    auto it = std::lower_bound(times_.begin(), times_.end(), t);
+    if (it == times_.begin()) {
+        yields_bar[0] += r_bar;
+        return;
+    }
+    if (it == times_.end()) {
+        yields_bar[times_.size() - 1] += r_bar;
+        return;
+    }
+
+    size_t index = it - times_.begin();
+    double w = (t - times_[index - 1]) / (times_[index] - times_[index - 1]);
+    yields_bar[index - 1] += (1.0 - w) * r_bar;
+    yields_bar[index] += w * r_bar;
+}
+
 void TermStructureInterpolated::setInterpolatedObservations(std::vector<double>& times, std::vector<double>& yields) {
     clear();
     if (times.size() != yields.size()) return;
 
     times_ = times;
     yields_ = yields;
+    indexKnots();
 }
 
 void TermStructureInterpolated::clear() {
     times_.clear();
     yields_.clear();
+    uniform_ = false;
+    inv_step_ = 0.0;
+    knots_.clear();
+}
+
+void TermStructureInterpolated::indexKnots() {
+    // A daily grid such as maturity_days_and_rates.csv skips the binary search entirely
+    size_t n = times_.size();
+    if (n < 2) return;
+    double step = (times_.back() - times_.front()) / (n - 1);
+    if (!(step > 0.0)) return;
+    for (size_t i = 1; i < n; ++i) {
+        if (std::abs(times_[i] - (times_.front() + i * step)) > 1e-9 * step) return;
+    }
+
+    uniform_ = true;
+    inv_step_ = 1.0 / step;
+    knots_.resize(2 * n);
+    for (size_t i = 0; i < n; ++i) {
+        knots_[2 * i] = times_[i];
+        knots_[2 * i + 1] = yields_[i];
+    }
 }
 
 
@@ -159,19 +318,16 @@ std::vector<double> TermStructureInterpolated::getTimes() const {
 }
 
 std::vector<double> TermStructureInterpolated::getDiscountFactors() const {
-    std::vector<double> discount_factors;
-    for (const double& time : times_) {
-        discount_factors.push_back(d(time));
-    }
+    std::vector<double> discount_factors(times_.size());
+    d(times_.data(), discount_factors.data(), times_.size());
     return discount_factors;
 }
 
 double bonds_price(const std::vector<double>& cashflow_times,
     const std::vector<double>& cashflows,
     const TermStructure& d) {
-    double p = 0;
-    for (int i = 0; i < cashflow_times.size(); i++) {
-        p += d.d(cashflow_times[i]) * cashflows[i];
-    }
-    return p;
+    std::vector<double> discount_factors(cashflow_times.size());
+    d.d(cashflow_times.data(), discount_factors.data(), cashflow_times.size());
+    return ConstArrayMap(discount_factors.data(), discount_factors.size()).matrix()
+        .dot(ConstArrayMap(cashflows.data(), cashflows.size()).matrix());
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #ifndef TERM_STRUCTURE_H
 #define TERM_STRUCTURE_H
 
+#include <cstddef>
 #include <vector>
 
 class TermStructure {
@@ -26,6 +27,8 @@ public:
     virtual double r(const double& t) const = 0; // yield on zero coupon bond
     virtual double d(const double& t) const = 0; // discount factor/price of zero coupon bond
     virtual double f(const double& t1, const double& t2) const = 0; // forward rate
+    virtual void r(const double* t, double* out, const size_t& n) const; // batch yields, out[k] = r(t[k])
+    virtual void d(const double* t, double* out, const size_t& n) const; // batch discount factors, out[k] = d(t[k])
     virtual ~TermStructure() {};
 
     static double yieldFromDiscountFactor(const double& d_t, const double& t);
@@ -34,10 +37,13 @@ public:
     static double forwardRateFromYields(const double& r_t1, const double& r_t2, const double& t1, const double& t2);
     static double nelsonSiegelSpotRate(double t, const NelsonSiegelParams& params);
     static double nelsonSiegelDiscountFactor(double t, const NelsonSiegelParams& params);
+    static void nelsonSiegelSpotRates(const double* t, double* out, const size_t& n, const NelsonSiegelParams& params);
+    static void nelsonSiegelDiscountFactors(const double* t, double* out, const size_t& n, const NelsonSiegelParams& params);
     static std::vector<double> bootstrapYieldCurve(const std::vector<Bond>& bonds);
+    static std::vector<double> bootstrapYieldCurve(const std::vector<Bond>& bonds, std::vector<double>& discountFactors);
 };
 
-class TermStructureFlat : public TermStructure {
+class TermStructureFlat final : public TermStructure {
 private:
     double R_; // interest rate
 public:
@@ -46,14 +52,20 @@ public:
     virtual double r(const double& t) const override;
     virtual double d(const double& t) const override;
     virtual double f(const double& t1, const double& t2) const override;
+    virtual void r(const double* t, double* out, const size_t& n) const override;
+    virtual void d(const double* t, double* out, const size_t& n) const override;
     void setIntRate(const double& r);
 };
 
-class TermStructureInterpolated : public TermStructure {
+class TermStructureInterpolated final : public TermStructure {
 private:
     std::vector<double> times_; // use to keep a list of yields
     std::vector<double> yields_;
+    bool uniform_; // knots are evenly spaced, r() computes the bracket directly
+    double inv_step_;
+    std::vector<double> knots_; // (time, yield) pairs interleaved for the uniform path
     void clear();
+    void indexKnots();
 public:
     TermStructureInterpolated();
     TermStructureInterpolated(const std::vector<double>& times, const std::vector<double>& yields);
@@ -63,14 +75,29 @@ public:
     virtual double r(const double& T) const override;
     virtual double d(const double& t) const override;
     virtual double f(const double& t1, const double& t2) const override;
+    virtual void r(const double* t, double* out, const size_t& n) const override;
+    virtual void d(const double* t, double* out, const size_t& n) const override;
+    // Adjoint of d(t): yields_bar[j] += d_bar * d d(t) / d yields[j], for the two knots around t
+    void dAdjoint(const double& t, const double& d_bar, double* yields_bar) const;
     void setInterpolatedObservations(std::vector<double>& times, std::vector<double>& yields);
     std::vector<double> getTimes() const; 
     std::vector<double> getDiscountFactors() const; 
 };
 
-#endif // TERM_STRUCTURE_H
-
+double bonds_price(const std::vector<double>& cashflow_times,
+                   const std::vector<double>& cashflows,
+                   const TermStructure& d);
 
+// Same as above for a concrete curve type, so d() is bound and inlined at compile time
+template <class Curve>
 double bonds_price(const std::vector<double>& cashflow_times,
                    const std::vector<double>& cashflows,
-                   const TermStructure& d);
\ No newline at end of file
+                   const Curve& d) {
+    double p = 0;
+    for (size_t i = 0; i < cashflow_times.size(); i++) {
+        p += d.d(cashflow_times[i]) * cashflows[i];
+    }
+    return p;
+}
+
+#endif // TERM_STRUCTURE_H
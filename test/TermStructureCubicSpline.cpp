@@ -0,0 +1,195 @@
+//TermStructureCubicSpline.cpp
+#include "TermStructureCubicSpline.h"
+#include "TermStructure.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "Eigen/Dense"
+
+// Thomas algorithm; sub[0] and sup[n - 1] are ignored. rhs is overwritten with the solution.
+static void solveTridiagonal(const std::vector<double>& sub, std::vector<double> diag,
+                             const std::vector<double>& sup, std::vector<double>& rhs) {
+    size_t n = diag.size();
+    for (size_t i = 1; i < n; ++i) {
+        double w = sub[i] / diag[i - 1];
+        diag[i] -= w * sup[i - 1];
+        rhs[i] -= w * rhs[i - 1];
+    }
+    rhs[n - 1] /= diag[n - 1];
+    for (size_t i = n - 1; i-- > 0;) {
+        rhs[i] = (rhs[i] - sup[i] * rhs[i + 1]) / diag[i];
+    }
+}
+
+TermStructureCubicSpline::TermStructureCubicSpline(const std::vector<double>& times, const std::vector<double>& yields,
+                                                   const SplineBoundary& boundary,
+                                                   const double& left_slope, const double& right_slope)
+    : times_(times), inv_bucket_width_(0.0) {
+    if (times.size() != yields.size()) times_.clear();
+    fit(yields, boundary, left_slope, right_slope, coeffs_);
+    // The coefficients are affine in the yields, so the spline through each unit yield, without
+    // the end slopes, holds their derivatives
+    std::vector<double> unit(times_.size(), 0.0), coeffs;
+    knot_coeffs_.resize(times_.size() * coeffs_.size());
+    for (size_t j = 0; j < times_.size(); ++j) {
+        unit[j] = 1.0;
+        fit(unit, boundary, 0.0, 0.0, coeffs);
+        std::copy(coeffs.begin(), coeffs.end(), knot_coeffs_.begin() + j * coeffs_.size());
+        unit[j] = 0.0;
+    }
+    indexSegments();
+}
+
+TermStructureCubicSpline::~TermStructureCubicSpline() {}
+
+void TermStructureCubicSpline::fit(const std::vector<double>& yields, const SplineBoundary& boundary,
+                                   const double& left_slope, const double& right_slope,
+                                   std::vector<double>& coeffs) const {
+    size_t n = times_.size();
+    coeffs.clear();
+    if (n == 0) return;
+    if (n == 1) {
+        coeffs.assign(4, 0.0);
+        coeffs[0] = yields[0];
+        return;
+    }
+
+    std::vector<double> h(n - 1), slope(n - 1);
+    for (size_t i = 0; i + 1 < n; ++i) {
+        h[i] = times_[i + 1] - times_[i];
+        slope[i] = (yields[i + 1] - yields[i]) / h[i];
+    }
+
+    // Second derivatives M at the knots
+    std::vector<double> M(n, 0.0);
+    if (boundary == SplineBoundary::NotAKnot && n == 3) {
+        // Not-a-knot on three points is the interpolating parabola
+        M.assign(3, 2.0 * (slope[1] - slope[0]) / (h[0] + h[1]));
+    } else if (boundary == SplineBoundary::NotAKnot && n >= 4) {
+        // Eliminate M_0 and M_{n-1} with h_1 M_0 - (h_0 + h_1) M_1 + h_0 M_2 = 0 and its mirror
+        size_t m = n - 2;
+        std::vector<double> sub(m), diag(m), sup(m), rhs(m);
+        for (size_t k = 0; k < m; ++k) {
+            size_t i = k + 1;
+            sub[k] = h[i - 1];
+            diag[k] = 2.0 * (h[i - 1] + h[i]);
+            sup[k] = h[i];
+            rhs[k] = 6.0 * (slope[i] - slope[i - 1]);
+        }
+        double h0 = h[0], h1 = h[1], hl = h[n - 2], hp = h[n - 3];
+        diag[0] += h0 * (h0 + h1) / h1;
+        sup[0] -= h0 * h0 / h1;
+        diag[m - 1] += hl * (hl + hp) / hp;
+        sub[m - 1] -= hl * hl / hp;
+        solveTridiagonal(sub, diag, sup, rhs);
+        for (size_t k = 0; k < m; ++k) M[k + 1] = rhs[k];
+        M[0] = ((h0 + h1) * M[1] - h0 * M[2]) / h1;
+        M[n - 1] = ((hl + hp) * M[n - 2] - hl * M[n - 3]) / hp;
+    } else if (boundary == SplineBoundary::Clamped) {
+        std::vector<double> sub(n), diag(n), sup(n), rhs(n);
+        diag[0] = 2.0 * h[0];
+        sup[0] = h[0];
+        rhs[0] = 6.0 * (slope[0] - left_slope);
+        for (size_t i = 1; i + 1 < n; ++i) {
+            sub[i] = h[i - 1];
+            diag[i] = 2.0 * (h[i - 1] + h[i]);
+            sup[i] = h[i];
+            rhs[i] = 6.0 * (slope[i] - slope[i - 1]);
+        }
+        sub[n - 1] = h[n - 2];
+        diag[n - 1] = 2.0 * h[n - 2];
+        rhs[n - 1] = 6.0 * (right_slope - slope[n - 2]);
+        solveTridiagonal(sub, diag, sup, rhs);
+        M = rhs;
+    } else if (n >= 3) {
+        // Natural, and the not-a-knot fallback on two points (a straight line)
+        size_t m = n - 2;
+        std::vector<double> sub(m), diag(m), sup(m), rhs(m);
+        for (size_t k = 0; k < m; ++k) {
+            size_t i = k + 1;
+            sub[k] = h[i - 1];
+            diag[k] = 2.0 * (h[i - 1] + h[i]);
+            sup[k] = h[i];
+            rhs[k] = 6.0 * (slope[i] - slope[i - 1]);
+        }
+        solveTridiagonal(sub, diag, sup, rhs);
+        for (size_t k = 0; k < m; ++k) M[k + 1] = rhs[k];
+    }
+
+    coeffs.resize(4 * (n - 1));
+    for (size_t i = 0; i + 1 < n; ++i) {
+        coeffs[4 * i] = yields[i];
+        coeffs[4 * i + 1] = slope[i] - h[i] * (2.0 * M[i] + M[i + 1]) / 6.0;
+        coeffs[4 * i + 2] = M[i] / 2.0;
+        coeffs[4 * i + 3] = (M[i + 1] - M[i]) / (6.0 * h[i]);
+    }
+}
+
+void TermStructureCubicSpline::indexSegments() {
+    // Four buckets per segment on average; each bucket stores the segment containing its start
+    buckets_.clear();
+    size_t n = times_.size();
+    if (n < 3) return;
+    size_t no_buckets = 4 * (n - 1);
+    inv_bucket_width_ = no_buckets / (times_.back() - times_.front());
+    buckets_.resize(no_buckets + 1);
+    size_t k = 0;
+    for (size_t b = 0; b <= no_buckets; ++b) {
+        double start = times_.front() + b / inv_bucket_width_;
+        while (k + 2 < n && times_[k + 1] <= start) ++k;
+        buckets_[b] = int(k);
+    }
+}
+
+size_t TermStructureCubicSpline::segment(const double& t) const {
+    size_t n = times_.size();
+    if (n < 3 || t <= times_.front()) return 0;
+    if (t >= times_.back()) return n - 2;
+    size_t k = buckets_[size_t((t - times_.front()) * inv_bucket_width_)];
+    while (k + 2 < n && times_[k + 1] <= t) ++k;
+    return k;
+}
+
+double TermStructureCubicSpline::r(const double& t) const {
+    if (coeffs_.empty()) return 0.0;
+    size_t k = segment(t);
+    const double* c = &coeffs_[4 * k];
+    double dx = t - times_[k];
+    return c[0] + dx * (c[1] + dx * (c[2] + dx * c[3]));
+}
+
+double TermStructureCubicSpline::d(const double& t) const {
+    return discountFactorFromYield(r(t), t);
+}
+
+double TermStructureCubicSpline::f(const double& t1, const double& t2) const {
+    double d1 = d(t1);
+    double d2 = d(t2);
+    return forwardRateFromDiscountFactors(d1, d2, t2 - t1);
+}
+
+void TermStructureCubicSpline::r(const double* t, double* out, const size_t& n) const {
+    for (size_t k = 0; k < n; ++k) out[k] = TermStructureCubicSpline::r(t[k]);
+}
+
+void TermStructureCubicSpline::d(const double* t, double* out, const size_t& n) const {
+    TermStructureCubicSpline::r(t, out, n);
+    Eigen::Map<Eigen::ArrayXd> yields(out, n);
+    yields = (-yields * Eigen::Map<const Eigen::ArrayXd>(t, n)).exp();
+}
+
+void TermStructureCubicSpline::dAdjoint(const double& t, const double& d_bar, double* yields_bar) const {
+    if (coeffs_.empty()) return;
+    // d = exp(-r t), r = sum_j r_j(t) y_j with r_j the spline through a unit yield at knot j
+    double r_bar = -t * d(t) * d_bar;
+    size_t k = segment(t);
+    double dx = t - times_[k];
+    for (size_t j = 0; j < times_.size(); ++j) {
+        const double* c = &knot_coeffs_[j * coeffs_.size() + 4 * k];
+        yields_bar[j] += r_bar * (c[0] + dx * (c[1] + dx * (c[2] + dx * c[3])));
+    }
+}
+
+std::vector<double> TermStructureCubicSpline::getTimes() const {
+    return times_;
+}
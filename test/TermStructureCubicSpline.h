@@ -0,0 +1,46 @@
+//TermStructureCubicSpline.h
+#ifndef TERM_STRUCTURE_CUBIC_SPLINE_H
+#define TERM_STRUCTURE_CUBIC_SPLINE_H
+
+#include "TermStructure.h"
+#include <vector>
+
+enum class SplineBoundary {
+    Natural,  // zero second derivative at both ends
+    Clamped,  // given first derivative at both ends
+    NotAKnot  // continuous third derivative at the second and second-to-last knots (SciPy default)
+};
+
+// Cubic spline through (time, yield) knots. Coefficients are solved once with a tridiagonal
+// system and stored per segment; a bucket index over the knot range finds the segment in O(1).
+// Outside the knots the end polynomials are extrapolated, as scipy.interpolate.CubicSpline does.
+class TermStructureCubicSpline final : public TermStructure {
+private:
+    std::vector<double> times_;
+    std::vector<double> coeffs_; // a, b, c, d of segment k at 4k: y = a + b dx + c dx^2 + d dx^3
+    std::vector<double> knot_coeffs_; // coeffs_ of the spline through a unit yield at knot j, at j coeffs_.size()
+    std::vector<int> buckets_;   // first segment overlapping each bucket of the knot range
+    double inv_bucket_width_;
+    void fit(const std::vector<double>& yields, const SplineBoundary& boundary,
+             const double& left_slope, const double& right_slope, std::vector<double>& coeffs) const;
+    void indexSegments();
+    size_t segment(const double& t) const;
+public:
+    TermStructureCubicSpline(const std::vector<double>& times, const std::vector<double>& yields,
+                             const SplineBoundary& boundary = SplineBoundary::NotAKnot,
+                             const double& left_slope = 0.0, const double& right_slope = 0.0);
+    virtual ~TermStructureCubicSpline();
+    using TermStructure::r;
+    using TermStructure::d;
+    virtual double r(const double& t) const override;
+    virtual double d(const double& t) const override;
+    virtual double f(const double& t1, const double& t2) const override;
+    virtual void r(const double* t, double* out, const size_t& n) const override;
+    virtual void d(const double* t, double* out, const size_t& n) const override;
+    // Adjoint of d(t): yields_bar[j] += d_bar * d d(t) / d yields[j] for every knot, since each
+    // segment's coefficients depend on all the yields through the spline's linear system
+    void dAdjoint(const double& t, const double& d_bar, double* yields_bar) const;
+    std::vector<double> getTimes() const;
+};
+
+#endif // TERM_STRUCTURE_CUBIC_SPLINE_H
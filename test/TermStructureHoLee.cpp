@@ -2,46 +2,182 @@
 #include "TermStructureHoLee.h"
 #include "TermStructure.h"
 #include <cmath>
+#include <algorithm>
 #include <vector>
 #include <iostream>
+#include <chrono>
 #include "Eigen/Dense"
 #include "unsupported/Eigen/NonLinearOptimization"
+#include "AutoDiffCalibration.h"
 
-TermStructureHoLee::TermStructureHoLee(TermStructure* fitted_term, const int& n, const int& i, const double& delta, const double& pi)
-    : initial_term_(fitted_term), n_(n), i_(i), delta_(delta), pi_(pi) {}
+TermStructureHoLee::TermStructureHoLee(const TermStructure* fitted_term, const int& n, const int& i, const double& delta, const double& pi,
+                                       const double& dt)
+    : initial_term_(fitted_term), n_(n), i_(i), delta_(delta), pi_(pi), dt_(dt) {}
 
 inline double hT(const double& T, const double& delta, const double& pi) {
     return (1.0 / (pi + (1 - pi) * pow(delta, T)));
 }
 
+HoLeeLogHTable::HoLeeLogHTable(const double& delta, const double& pi, const int& origin)
+    : delta_(delta), pi_(pi), log_delta_(log(delta)), origin_(origin) {}
+
+void HoLeeLogHTable::reset(const double& delta, const double& pi, const int& origin) {
+    delta_ = delta;
+    pi_ = pi;
+    log_delta_ = log(delta);
+    origin_ = origin;
+    for (auto& sums : sums_) sums.second.clear();
+}
+
+void HoLeeLogHTable::logH(const double& x, double* out) const {
+    logH(x, pow(delta_, x), out);
+}
+
+void HoLeeLogHTable::logH(const double& x, const double& power, double* out) const {
+    // log h = -log q with q = pi + (1 - pi) delta^x
+    double q = pi_ + (1 - pi_) * power;
+    out[0] = -log(q);
+    out[1] = -(1 - pi_) * x * power / (delta_ * q);
+    out[2] = -(1 - power) / q;
+}
+
+const std::vector<double>& HoLeeLogHTable::row(const double& frac, const int& start, const int& m) {
+    std::vector<double>& sums = sums_[std::make_pair(frac, start)];
+    if (sums.empty()) sums.assign(3, 0.0);
+    double term[3];
+    double power = 0.0;
+    bool seeded = false;
+    while (start + int(sums.size() / 3) <= m) {
+        size_t k = sums.size() / 3;
+        // delta^x by one multiplication per entry, taken afresh every 64 entries to bound the rounding
+        double x = frac + start + k;
+        power = seeded && (start + k) % 64 != 0 ? power * delta_ : pow(delta_, x);
+        seeded = true;
+        logH(x, power, term);
+        for (int c = 0; c < 3; ++c) sums.push_back(sums[3 * (k - 1) + c] + term[c]);
+    }
+    return sums;
+}
+
+double HoLeeLogHTable::logNodeFactor(const int& n, const int& i, const double& T) {
+    double d_delta, d_pi;
+    return logNodeFactor(n, i, T, d_delta, d_pi);
+}
+
+double HoLeeLogHTable::logNodeFactor(const int& n, const int& i, const double& T, double& d_delta, double& d_pi) {
+    double log_factor[3];
+    logH(n, log_factor);
+    if (n > 1) {
+        // prod_{j=1}^{n-1} h(T + n - j) / h(n - j) = exp(S_frac(w + n - 1) - S_frac(w) - S_0(n - 1)), T = w + frac
+        int w = int(floor(T));
+        double frac = T - w;
+        int start = w >= origin_ ? origin_ : 0;
+        const std::vector<double>& shifted = row(frac, start, w + n - 1);
+        const std::vector<double>& whole = row(0.0, 0, n - 1);
+        for (int c = 0; c < 3; ++c) {
+            log_factor[c] += shifted[3 * (w + n - 1 - start) + c] - shifted[3 * (w - start) + c] - whole[3 * (n - 1) + c];
+        }
+    }
+    if (n != i) {
+        log_factor[0] += T * (n - i) * log_delta_;
+        log_factor[1] += T * (n - i) / delta_;
+    }
+    d_delta = log_factor[1];
+    d_pi = log_factor[2];
+    return log_factor[0];
+}
+
+HoLeeLogHTable& TermStructureHoLee::logHTable() const {
+    if (!log_h_table_ || !log_h_table_->matches(delta_, pi_)) {
+        log_h_table_ = std::make_shared<HoLeeLogHTable>(delta_, pi_);
+    }
+    return *log_h_table_;
+}
+
 double TermStructureHoLee::d(const double& T) const {
-    double d = initial_term_->d(T + n_) / initial_term_->d(n_);
+    double d = initial_term_->d(T + n_ * dt_) / initial_term_->d(n_ * dt_);
+    return d * exp(logHTable().logNodeFactor(n_, i_, hoLeePeriods(T, dt_)));
+}
+
+void TermStructureHoLee::d(const double* T, double* out, const size_t& n) const {
+    std::vector<double> scratch(T, T + n);
+    for (size_t k = 0; k < n; ++k) scratch[k] += n_ * dt_;
+    initial_term_->d(scratch.data(), out, n);
+
+    HoLeeLogHTable& table = logHTable();
+    for (size_t k = 0; k < n; ++k) scratch[k] = table.logNodeFactor(n_, i_, hoLeePeriods(T[k], dt_));
+    Eigen::Map<Eigen::ArrayXd>(out, n) *= Eigen::Map<Eigen::ArrayXd>(scratch.data(), n).exp() / initial_term_->d(n_ * dt_);
+}
+
+static size_t nearestInstrument(const std::vector<double>& market_times, const double& tenor) {
+    size_t nearest = 0;
+    for (size_t k = 1; k < market_times.size(); ++k) {
+        if (std::abs(market_times[k] - tenor) < std::abs(market_times[nearest] - tenor)) nearest = k;
+    }
+    return nearest;
+}
 
+static std::vector<size_t> sortedUnique(std::vector<size_t> indices) {
+    std::sort(indices.begin(), indices.end());
+    indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+    return indices;
+}
 
-    for (int j = 1; j < n_; ++j) {
-        double hT1 = hT(T + (n_ - j), delta_, pi_);
-        double hT2 = hT(n_ - j, delta_, pi_);
-        d *= hT1 / hT2;
+std::vector<size_t> selectInstrumentsByTenor(const std::vector<double>& market_times, const std::vector<double>& tenors) {
+    std::vector<size_t> indices;
+    if (market_times.empty()) return indices;
+    for (const double& tenor : tenors) indices.push_back(nearestInstrument(market_times, tenor));
+    return sortedUnique(indices);
+}
 
+std::vector<size_t> selectInstrumentsLogSpaced(const std::vector<double>& market_times, const size_t& count) {
+    std::vector<size_t> indices;
+    double first = 0.0, last = 0.0;
+    for (const double& t : market_times) {
+        if (t <= 0) continue;
+        if (first == 0.0 || t < first) first = t;
+        last = std::max(last, t);
+    }
+    if (count == 0 || first == 0.0) return indices;
+    if (count == 1) return std::vector<size_t>(1, nearestInstrument(market_times, last));
+    for (size_t j = 0; j < count; ++j) {
+        double tenor = first * pow(last / first, double(j) / (count - 1));
+        indices.push_back(nearestInstrument(market_times, tenor));
     }
+    return sortedUnique(indices);
+}
 
-    double hT_final = hT(n_, delta_, pi_);
-    double pow_delta = pow(delta_, T * (n_ - i_));
-    d *= hT_final * pow_delta;
+std::vector<size_t> selectInstrumentsByLiquidity(const std::vector<double>& liquidity, const size_t& count) {
+    std::vector<size_t> indices(liquidity.size());
+    for (size_t k = 0; k < indices.size(); ++k) indices[k] = k;
+    size_t selected = std::min(count, indices.size());
+    std::partial_sort(indices.begin(), indices.begin() + selected, indices.end(), [&](const size_t& a, const size_t& b) {
+        return liquidity[a] > liquidity[b] || (liquidity[a] == liquidity[b] && a < b);
+    });
+    indices.resize(selected);
+    return sortedUnique(indices);
+}
 
-    return d;
+std::vector<double> gatherInstruments(const std::vector<double>& values, const std::vector<size_t>& indices) {
+    std::vector<double> selected;
+    selected.reserve(indices.size());
+    for (const size_t& k : indices) selected.push_back(values[k]);
+    return selected;
 }
 
 std::vector<std::vector<TermStructureHoLee>> buildTermStructureTree(TermStructure* initial, 
                                                                     const int& no_steps, 
                                                                     const double& delta, 
-                                                                    const double& pi) {
+                                                                    const double& pi,
+                                                                    const double& dt) {
     std::vector<std::vector<TermStructureHoLee>> hl_tree;
+    std::shared_ptr<HoLeeLogHTable> log_h_table = std::make_shared<HoLeeLogHTable>(delta, pi);
 
     for (int t = 0; t < no_steps; ++t) {
         hl_tree.push_back(std::vector<TermStructureHoLee>());
         for (int j = 0; j <= t; ++j) {
-            TermStructureHoLee hl(initial, t, j, delta, pi); 
+            TermStructureHoLee hl(initial, t, j, delta, pi, dt); 
+            hl.log_h_table_ = log_h_table;
             hl_tree[t].push_back(hl);
         }
     }
@@ -52,73 +188,350 @@ void TermStructureHoLee::print(const size_t& row, const size_t& node) const {
     std::cout << "1 year Discount factor at row " << row << " node " << node << " is " << d(1.0) << std::endl;
 }
 
-// Functor for Levenberg-Marquardt algorithm
+// Functor for Levenberg-Marquardt algorithm. Residuals and both Jacobian columns come from one
+// pass over the market points using the closed-form derivatives of log d(T) in delta and pi.
+// D(T + n dt) / D(n dt) does not depend on either parameter and is computed once up front.
+// Rows are evaluated in fixed blocks, each with its own HoLeeLogHTable anchored at the block's
+// earliest maturity in periods, so blocks can run on any thread and give the same result either way. A row
+// more than 2n past the previous one starts a new table at its own maturity, so a sparse set of
+// instruments does not pay for the maturities between them. Weighted rows are scaled by sqrt(w).
+// All buffers live in the workspace, whose tables are reset rather than rebuilt on every evaluation.
 struct Functor {
-    const TermStructureHoLee& model;
+    static const int rows_per_block = 512;
+
     const std::vector<double>& market_times;
     const std::vector<double>& market_prices;
+    int n;
+    int i;
+    HoLeeCalibrationWorkspace& workspace;
+    const std::vector<double>& periods;
+    const Eigen::VectorXd& forward;
+    const Eigen::VectorXd& sqrt_weights;
+    Eigen::ThreadPool* pool; // blocks run serially when null
+    int threads;
+    Eigen::VectorXd& jacobian_x;
+    Eigen::MatrixXd& jacobian;
 
-    Functor(const TermStructureHoLee& model, const std::vector<double>& market_times, const std::vector<double>& market_prices)
-        : model(model), market_times(market_times), market_prices(market_prices) {}
+    Functor(const TermStructureHoLee& model, const std::vector<double>& market_times, const std::vector<double>& market_prices,
+            HoLeeCalibrationWorkspace& workspace, Eigen::ThreadPool* pool = nullptr, const int& threads = 1,
+            const std::vector<double>* weights = nullptr)
+        : market_times(market_times), market_prices(market_prices), n(model.n_), i(model.i_), workspace(workspace),
+          periods(workspace.periods), forward(workspace.forward), sqrt_weights(workspace.sqrt_weights),
+          pool(pool), threads(pool ? std::max(1, threads) : 1), jacobian_x(workspace.jacobian_x), jacobian(workspace.jacobian) {
+        workspace.periods.resize(market_times.size());
+        workspace.shifted.assign(market_times.begin(), market_times.end());
+        for (size_t k = 0; k < market_times.size(); ++k) {
+            workspace.periods[k] = hoLeePeriods(market_times[k], model.dt_);
+            workspace.shifted[k] += n * model.dt_;
+        }
+        workspace.forward.resize(market_times.size());
+        model.initial_term_->d(workspace.shifted.data(), workspace.forward.data(), workspace.shifted.size());
+        workspace.forward /= model.initial_term_->d(n * model.dt_);
+        if (weights && !weights->empty()) {
+            workspace.sqrt_weights = Eigen::Map<const Eigen::VectorXd>(weights->data(), weights->size()).cwiseSqrt();
+        } else {
+            workspace.sqrt_weights.resize(0);
+        }
+        workspace.jacobian_x.resize(0);
+        size_t blocks = (market_times.size() + rows_per_block - 1) / rows_per_block;
+        if (workspace.tables.size() < blocks) workspace.tables.resize(blocks, HoLeeLogHTable(model.delta_, model.pi_));
+    }
 
-    int operator()(const Eigen::VectorXd& x, Eigen::VectorXd& fvec) const {
-        double delta = x[0];
-        double pi = x[1];
-
-        for (size_t i = 0; i < market_times.size(); ++i) {
-            TermStructureHoLee temp_model(model);
-            temp_model.delta_ = delta;
-            temp_model.pi_ = pi;
-            fvec[i] = temp_model.d(market_times[i]) - market_prices[i];
+    void evaluateBlock(const Eigen::VectorXd& x, const int& block, Eigen::VectorXd& fvec, Eigen::MatrixXd& fjac) const {
+        size_t begin = size_t(block) * rows_per_block;
+        size_t end = std::min(begin + rows_per_block, market_times.size());
+        double earliest = *std::min_element(periods.begin() + begin, periods.begin() + end);
+        int last = std::max(0, int(floor(earliest)));
+        HoLeeLogHTable& table = workspace.tables[block];
+        table.reset(x[0], x[1], last);
+        for (size_t k = begin; k < end; ++k) {
+            int w = int(floor(periods[k]));
+            if (w - last > 2 * n) table.reset(x[0], x[1], w);
+            last = w;
+            double d_delta, d_pi;
+            double price = forward[k] * exp(table.logNodeFactor(n, i, periods[k], d_delta, d_pi));
+            fvec[k] = price - market_prices[k];
+            fjac(k, 0) = price * d_delta;
+            fjac(k, 1) = price * d_pi;
+            if (sqrt_weights.size() > 0) {
+                fvec[k] *= sqrt_weights[k];
+                fjac.row(k) *= sqrt_weights[k];
+            }
+        }
+    }
+
+    void evaluate(const Eigen::VectorXd& x, Eigen::VectorXd& fvec, Eigen::MatrixXd& fjac) const {
+        int blocks = int((market_times.size() + rows_per_block - 1) / rows_per_block);
+        int workers = std::min(threads, blocks);
+        if (workers <= 1) {
+            for (int block = 0; block < blocks; ++block) evaluateBlock(x, block, fvec, fjac);
+            return;
+        }
+        // Worker w takes blocks w, w + workers, ...; every block writes its own rows
+        Eigen::Barrier done(workers);
+        for (int w = 0; w < workers; ++w) {
+            pool->Schedule([&, w]() {
+                for (int block = w; block < blocks; block += workers) evaluateBlock(x, block, fvec, fjac);
+                done.Notify();
+            });
         }
+        done.Wait();
+    }
 
+    int operator()(const Eigen::VectorXd& x, Eigen::VectorXd& fvec) const {
+        jacobian.resize(values(), inputs());
+        evaluate(x, fvec, jacobian);
+        jacobian_x = x;
         return 0;
     }
 
     int df(const Eigen::VectorXd& x, Eigen::MatrixXd& fjac) const {
-        double delta = x[0];
-        double pi = x[1];
-        double epsilon = 1e-8;
+        // The solver asks for the Jacobian at the point it has just evaluated
+        if (jacobian_x.size() == x.size() && jacobian_x == x) {
+            fjac = jacobian;
+            return 0;
+        }
+        Eigen::VectorXd fvec(values());
+        evaluate(x, fvec, fjac);
+        return 0;
+    }
 
-        for (size_t i = 0; i < market_times.size(); ++i) {
-            // Partial derivative with respect to delta
-            TermStructureHoLee temp_model_delta(model);
-            temp_model_delta.delta_ = delta + epsilon;
-            temp_model_delta.pi_ = pi;
-            double f_delta = temp_model_delta.d(market_times[i]);
+    int inputs() const { return 2; }
+    int values() const { return market_times.size(); }
+};
 
-            temp_model_delta.delta_ = delta - epsilon;
-            double f_delta_minus = temp_model_delta.d(market_times[i]);
+HoLeeCalibrationSettings::HoLeeCalibrationSettings()
+    : ftol(std::sqrt(Eigen::NumTraits<double>::epsilon())), xtol(std::sqrt(Eigen::NumTraits<double>::epsilon())), maxfev(400),
+      threads(1), pool(nullptr) {}
 
-            fjac(i, 0) = (f_delta - f_delta_minus) / (2 * epsilon);
+void TermStructureHoLee::calibrate(const std::vector<double>& market_times, const std::vector<double>& market_prices) {
+    calibrate(market_times, market_prices, HoLeeCalibrationSettings());
+}
 
-            // Partial derivative with respect to pi
-            TermStructureHoLee temp_model_pi(model);
-            temp_model_pi.delta_ = delta;
-            temp_model_pi.pi_ = pi + epsilon;
-            double f_pi = temp_model_pi.d(market_times[i]);
+HoLeeCalibrationReport::HoLeeCalibrationReport()
+    : status(Eigen::LevenbergMarquardtSpace::NotStarted), iterations(0), nfev(0), njev(0), fnorm(0.0), cached(false), setup_ms(0.0), solve_ms(0.0) {}
 
-            temp_model_pi.pi_ = pi - epsilon;
-            double f_pi_minus = temp_model_pi.d(market_times[i]);
+static double elapsedMilliseconds(const std::chrono::steady_clock::time_point& start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
 
-            fjac(i, 1) = (f_pi - f_pi_minus) / (2 * epsilon);
+// Pool for a solve over rows instruments: none when they fit in one block or one thread is asked
+// for, the caller's pool when given, otherwise one started into owned for the solve
+static Eigen::ThreadPool* calibrationPool(const HoLeeCalibrationSettings& settings, const size_t& rows,
+                                          std::unique_ptr<Eigen::ThreadPool>& owned) {
+    int blocks = int((rows + Functor::rows_per_block - 1) / Functor::rows_per_block);
+    if (settings.threads <= 1 || blocks <= 1) return nullptr;
+    if (settings.pool) return settings.pool;
+    owned.reset(new Eigen::ThreadPool(std::min(settings.threads, blocks)));
+    return owned.get();
+}
+
+static void minimize(Functor& functor, Eigen::VectorXd& x, const HoLeeCalibrationSettings& settings,
+                     HoLeeCalibrationReport& report) {
+    Eigen::LevenbergMarquardt<Functor> lm(functor);
+    lm.parameters.ftol = settings.ftol;
+    lm.parameters.xtol = settings.xtol;
+    lm.parameters.maxfev = settings.maxfev;
+    report.status = lm.minimize(x);
+    report.iterations = int(lm.iter);
+    report.nfev = int(lm.nfev);
+    report.njev = int(lm.njev);
+    report.fnorm = lm.fnorm;
+}
+
+void TermStructureHoLee::calibrate(const std::vector<double>& market_times, const std::vector<double>& market_prices,
+                                   const HoLeeCalibrationSettings& settings) {
+    HoLeeCalibrationReport report;
+    calibrate(market_times, market_prices, settings, report);
+}
+
+void TermStructureHoLee::calibrate(const std::vector<double>& market_times, const std::vector<double>& market_prices,
+                                   const HoLeeCalibrationSettings& settings, HoLeeCalibrationReport& report) {
+    calibrate(market_times, market_prices, std::vector<double>(), settings, report);
+}
+
+void TermStructureHoLee::calibrate(const std::vector<double>& market_times, const std::vector<double>& market_prices,
+                                   const std::vector<double>& weights,
+                                   const HoLeeCalibrationSettings& settings, HoLeeCalibrationReport& report) {
+    HoLeeCalibrationWorkspace workspace;
+    calibrate(market_times, market_prices, weights, settings, report, workspace);
+}
+
+void TermStructureHoLee::calibrate(const std::vector<double>& market_times, const std::vector<double>& market_prices,
+                                   const std::vector<double>& weights,
+                                   const HoLeeCalibrationSettings& settings, HoLeeCalibrationReport& report,
+                                   HoLeeCalibrationWorkspace& workspace) {
+    if (!weights.empty() && weights.size() != market_times.size()) {
+        std::cerr << "Calibration weights do not match the market instruments" << std::endl;
+        report = HoLeeCalibrationReport();
+        report.status = Eigen::LevenbergMarquardtSpace::ImproperInputParameters;
+        return;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    Eigen::VectorXd x(2);
+    x[0] = delta_;
+    x[1] = pi_;
+
+    std::unique_ptr<Eigen::ThreadPool> owned_pool;
+    Eigen::ThreadPool* pool = calibrationPool(settings, market_times.size(), owned_pool);
+
+    Functor functor(*this, market_times, market_prices, workspace, pool, settings.threads, &weights);
+    report.setup_ms = elapsedMilliseconds(start);
+    start = std::chrono::steady_clock::now();
+    minimize(functor, x, settings, report);
+    report.solve_ms = elapsedMilliseconds(start);
+
+    delta_ = x[0];
+    pi_ = x[1];
+}
+
+HoLeeCalibrationState::HoLeeCalibrationState()
+    : solved(false), n(0), i(0), dt(1.0), delta(0.0), pi(0.0), fnorm(0.0) {}
+
+bool TermStructureHoLee::recalibrate(const std::vector<double>& market_times, const std::vector<double>& market_prices,
+                                     HoLeeCalibrationState& state, const HoLeeCalibrationSettings& settings,
+                                     HoLeeCalibrationReport& report, HoLeeCalibrationWorkspace& workspace) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    report = HoLeeCalibrationReport();
+    bool warm = state.solved && state.n == n_ && state.i == i_ && state.dt == dt_
+                && state.market_times == market_times;
+    if (warm) {
+        delta_ = state.delta;
+        pi_ = state.pi;
+    }
+    Eigen::VectorXd x(2);
+    x[0] = delta_;
+    x[1] = pi_;
+
+    std::unique_ptr<Eigen::ThreadPool> owned_pool;
+    Eigen::ThreadPool* pool = calibrationPool(settings, market_times.size(), owned_pool);
+
+    Functor functor(*this, market_times, market_prices, workspace, pool, settings.threads);
+    report.setup_ms = elapsedMilliseconds(start);
+    start = std::chrono::steady_clock::now();
+    Eigen::VectorXd fvec(functor.values());
+    if (warm) {
+        // The residuals at the previous solution come with their Jacobian, so the step is free
+        functor(x, fvec);
+        const Eigen::MatrixXd& jac = functor.jacobian;
+        Eigen::Vector2d step = -(jac.transpose() * jac).ldlt().solve(jac.transpose() * fvec);
+        double fnorm = fvec.norm();
+        if (step.allFinite() && step.norm() <= settings.xtol * (x.norm() + settings.xtol)) {
+            report.status = Eigen::LevenbergMarquardtSpace::RelativeErrorTooSmall;
+            report.nfev = 1;
+            report.njev = 1;
+            report.fnorm = fnorm;
+            report.solve_ms = elapsedMilliseconds(start);
+            return false;
+        }
+        if (step.allFinite()) {
+            Eigen::VectorXd trial = x + step;
+            functor(trial, fvec);
+            if (fvec.norm() < fnorm) x = trial;
         }
+    }
 
-        return 0;
+    minimize(functor, x, settings, report);
+    report.solve_ms = elapsedMilliseconds(start);
+    delta_ = x[0];
+    pi_ = x[1];
+    if (!report.converged()) return true;
+
+    state.solved = true;
+    state.n = n_;
+    state.i = i_;
+    state.dt = dt_;
+    state.delta = delta_;
+    state.pi = pi_;
+    state.fnorm = report.fnorm;
+    if (!warm) state.market_times = market_times;
+    return true;
+}
+
+// Adds sign * log h(x) = -sign * log(pi + (1 - pi) delta^x) with its gradient and Hessian in (delta, pi)
+static void addLogH(const double& x, const double& delta, const double& pi, const double& sign,
+                    double& value, Eigen::Vector2d& gradient, Eigen::Matrix2d& hessian) {
+    double power = std::pow(delta, x);
+    double u = pi + (1.0 - pi) * power;
+    Eigen::Vector2d du((1.0 - pi) * x * power / delta, 1.0 - power);
+    Eigen::Matrix2d d2u;
+    d2u << (1.0 - pi) * x * (x - 1.0) * power / (delta * delta), -x * power / delta,
+           -x * power / delta, 0.0;
+    value -= sign * std::log(u);
+    gradient -= sign * du / u;
+    hessian += sign * (du * du.transpose() / (u * u) - d2u / u);
+}
+
+void TermStructureHoLee::calibrationAdjoint(const std::vector<double>& market_times, const std::vector<double>& market_prices,
+                                            const double& delta_bar, const double& pi_bar,
+                                            std::vector<double>& log_forwards_bar,
+                                            std::vector<double>& market_prices_bar) const {
+    // Residual k is r_k = F_k P_k(x) - M_k with F_k = D(T_k + n dt) / D(n dt). The optimum solves
+    // g = sum_k r_k grad r_k = 0, so dx = -H^-1 dg with the full Hessian H = J'J + sum_k r_k hess r_k;
+    // the residuals are not zero at the fit, so the Gauss-Newton J'J alone is not enough.
+    // log P_k is summed term by term as in HoLeeZeroCouponModel.
+    HoLeeZeroCouponModel model(*this, market_times, market_prices);
+    double whole = 0.0;
+    Eigen::Vector2d whole_gradient = Eigen::Vector2d::Zero();
+    Eigen::Matrix2d whole_hessian = Eigen::Matrix2d::Zero();
+    addLogH(double(n_), delta_, pi_, 1.0, whole, whole_gradient, whole_hessian);
+    for (int j = 1; j < n_; ++j) addLogH(double(j), delta_, pi_, -1.0, whole, whole_gradient, whole_hessian);
+
+    size_t count = market_times.size();
+    Eigen::Matrix2d hessian = Eigen::Matrix2d::Zero();
+    std::vector<Eigen::Vector2d> gradients(count);
+    std::vector<double> model_prices(count);
+    for (size_t k = 0; k < count; ++k) {
+        const double& T = model.periods[k];
+        double log_factor = whole;
+        Eigen::Vector2d log_gradient = whole_gradient;
+        Eigen::Matrix2d log_hessian = whole_hessian;
+        for (int j = 1; j < n_; ++j) addLogH(T + j, delta_, pi_, 1.0, log_factor, log_gradient, log_hessian);
+        if (n_ != i_) {
+            log_factor += T * (n_ - i_) * std::log(delta_);
+            log_gradient[0] += T * (n_ - i_) / delta_;
+            log_hessian(0, 0) -= T * (n_ - i_) / (delta_ * delta_);
+        }
+        model_prices[k] = model.forward[k] * std::exp(log_factor);
+        double r = model_prices[k] - market_prices[k];
+        gradients[k] = model_prices[k] * log_gradient;
+        hessian += gradients[k] * gradients[k].transpose()
+                 + r * model_prices[k] * (log_hessian + log_gradient * log_gradient.transpose());
     }
 
-    int inputs() const { return 2; }
-    int values() const { return market_times.size(); }
-};
+    // With lambda = H^-1 x_bar: dg / dlog F_k = (2 F_k P_k - M_k) grad r_k and dg / dM_k = -grad r_k
+    Eigen::Vector2d lambda = hessian.ldlt().solve(Eigen::Vector2d(delta_bar, pi_bar));
+    log_forwards_bar.resize(count);
+    market_prices_bar.resize(count);
+    for (size_t k = 0; k < count; ++k) {
+        double projected = lambda.dot(gradients[k]);
+        log_forwards_bar[k] = -projected * (2.0 * model_prices[k] - market_prices[k]);
+        market_prices_bar[k] = projected;
+    }
+}
 
-void TermStructureHoLee::calibrate(const std::vector<double>& market_times, const std::vector<double>& market_prices) {
+HoLeeZeroCouponModel::HoLeeZeroCouponModel(const TermStructureHoLee& model, const std::vector<double>& market_times,
+                                           const std::vector<double>& market_prices)
+    : market_times(market_times), market_prices(market_prices), n(model.n_), i(model.i_), periods(market_times.size()),
+      forward(market_times.size()) {
+    std::vector<double> shifted(market_times);
+    for (size_t k = 0; k < shifted.size(); ++k) {
+        periods[k] = hoLeePeriods(market_times[k], model.dt_);
+        shifted[k] += n * model.dt_;
+    }
+    model.initial_term_->d(shifted.data(), forward.data(), shifted.size());
+    double d_n = model.initial_term_->d(n * model.dt_);
+    for (double& d : forward) d /= d_n;
+}
+
+void TermStructureHoLee::calibrateAutoDiff(const std::vector<double>& market_times, const std::vector<double>& market_prices,
+                                           const HoLeeCalibrationSettings& settings) {
     Eigen::VectorXd x(2);
     x[0] = delta_;
     x[1] = pi_;
 
-    Functor functor(*this, market_times, market_prices);
-    Eigen::LevenbergMarquardt<Functor> lm(functor);
-    lm.minimize(x);
+    HoLeeZeroCouponModel model(*this, market_times, market_prices);
+    ::calibrateAutoDiff(model, x, settings.ftol, settings.xtol, settings.maxfev);
 
     delta_ = x[0];
     pi_ = x[1];
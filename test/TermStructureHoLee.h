@@ -4,31 +4,368 @@
 
 #include "TermStructure.h"
 #include <vector>
+#include <map>
+#include <memory>
+#include <cmath>
+#include <algorithm>
 #include "Eigen/Dense"
+#include "unsupported/Eigen/CXX11/ThreadPool"
+
+// Maturity T in lattice periods of length dt, snapped to the nearest whole period when within
+// rounding of it, so that grids such as dt = 1 / 365 keep whole maturities on whole periods
+inline double hoLeePeriods(const double& T, const double& dt) {
+    double periods = T / dt;
+    double whole = std::floor(periods + 0.5);
+    return std::abs(periods - whole) <= 1e-9 * std::max(1.0, std::abs(whole)) ? whole : periods;
+}
+
+// Prefix sums of log h(x) = -log(pi + (1 - pi) * delta^x) for one (delta, pi) pair, together with
+// their derivatives in delta and pi. Rows are keyed by the fractional part of the maturity and
+// grown on demand, so a node discount factor and its gradient need a few lookups and one exp
+// instead of an O(n) loop. Not safe for concurrent use; every tree shares one table per thread.
+// Sums over maturities of at least origin start at origin rather than 0, so a table serving a
+// block of maturities does not depend on the blocks before it.
+class HoLeeLogHTable {
+private:
+    double delta_;
+    double pi_;
+    double log_delta_;
+    int origin_;
+    // sums_[(frac, start)][3(k - start) + c] = sum of log h(frac + j) for start < j <= k,
+    // c = value, d/d delta, d/d pi
+    std::map<std::pair<double, int>, std::vector<double>> sums_;
+    const std::vector<double>& row(const double& frac, const int& start, const int& m); // row reaching k = m
+    void logH(const double& x, double* out) const; // log h(x) and its derivatives
+    void logH(const double& x, const double& power, double* out) const; // given power = delta^x
+public:
+    HoLeeLogHTable(const double& delta, const double& pi, const int& origin = 0);
+    void reset(const double& delta, const double& pi, const int& origin = 0); // keeps the rows' storage
+    bool matches(const double& delta, const double& pi) const { return delta == delta_ && pi == pi_; }
+    double logDelta() const { return log_delta_; }
+    double logNodeFactor(const int& n, const int& i, const double& T); // log of d(T) / (D(T + n) / D(n))
+    double logNodeFactor(const int& n, const int& i, const double& T, double& d_delta, double& d_pi);
+};
+
+// Levenberg-Marquardt stopping criteria for TermStructureHoLee::calibrate (Eigen's defaults), and
+// the number of threads evaluating the residuals and Jacobian. The result does not depend on threads.
+// Threads run on pool when one is given, else on a pool started for the solve, and only when the
+// instruments span more than one block of rows.
+struct HoLeeCalibrationSettings {
+    double ftol;
+    double xtol;
+    int maxfev;
+    int threads;
+    Eigen::ThreadPool* pool; // long-lived, owned by the caller; may be null
+
+    HoLeeCalibrationSettings();
+};
+
+// Outcome of a TermStructureHoLee::calibrate solve. Wall times are split into setup (initial
+// curve discount factors and thread pool) and the Levenberg-Marquardt solve itself.
+struct HoLeeCalibrationReport {
+    int status; // Eigen::LevenbergMarquardtSpace::Status
+    int iterations;
+    int nfev; // residual evaluations
+    int njev; // Jacobian evaluations
+    double fnorm; // residual norm at the solution
+    bool cached; // taken from a HoLeeCalibrationCache without solving
+    double setup_ms;
+    double solve_ms;
+
+    HoLeeCalibrationReport();
+    bool converged() const { return status >= 1 && status <= 4; }
+};
+
+// Buffers of a TermStructureHoLee::calibrate solve, kept by callers that calibrate one curve after
+// another so each solve reuses the storage of the last: the instruments' periods and forward
+// discount factors, the Jacobian, and one HoLeeLogHTable per block of rows. One per thread.
+struct HoLeeCalibrationWorkspace {
+    std::vector<double> periods; // market times in periods of the model's dt
+    std::vector<double> shifted; // market times plus n dt
+    Eigen::VectorXd forward; // D(T + n dt) / D(n dt) at each market time
+    Eigen::VectorXd sqrt_weights; // empty for equal weights
+    Eigen::VectorXd jacobian_x; // point of the last residual evaluation
+    Eigen::MatrixXd jacobian; // Jacobian computed alongside those residuals
+    std::vector<HoLeeLogHTable> tables;
+};
+
+// Last converged solution of TermStructureHoLee::recalibrate, kept by the caller between curve
+// updates together with a HoLeeCalibrationWorkspace
+struct HoLeeCalibrationState {
+    bool solved;
+    int n;
+    int i;
+    double dt;
+    double delta;
+    double pi;
+    double fnorm; // residual norm at (delta, pi) against the prices of the solve
+    std::vector<double> market_times;
+
+    HoLeeCalibrationState();
+};
 
 class TermStructureHoLee : public TermStructure {
 public:
-    TermStructure* initial_term_;
+    const TermStructure* initial_term_;
     int n_; //number of step
     int i_; //statue i
     double delta_;
     double pi_; // Implied Binomial Probabilit
+    double dt_; // period length in the time unit of the initial curve; delta_ is per period
+    mutable std::shared_ptr<HoLeeLogHTable> log_h_table_; // rebuilt lazily when delta_ or pi_ change
 
-    TermStructureHoLee(TermStructure* fitted_term, const int& n, const int& i, const double& delta, const double& pi);
+    TermStructureHoLee(const TermStructure* fitted_term, const int& n, const int& i, const double& delta, const double& pi,
+                       const double& dt = 1.0);
 
+    using TermStructure::r;
+    using TermStructure::d;
     virtual double r(const double& t) const override { return 0.0; } // Not implemented
     virtual double d(const double& T) const override;
     virtual double f(const double& t1, const double& t2) const override { return 0.0; } // Not implemented
+    virtual void d(const double* T, double* out, const size_t& n) const override;
 
     void print(const size_t& row, const size_t& node) const; // Declare the print method
 
     void calibrate(const std::vector<double>& market_times, const std::vector<double>& market_prices); // Calibration method
+    void calibrate(const std::vector<double>& market_times, const std::vector<double>& market_prices,
+                   const HoLeeCalibrationSettings& settings);
+    void calibrate(const std::vector<double>& market_times, const std::vector<double>& market_prices,
+                   const HoLeeCalibrationSettings& settings, HoLeeCalibrationReport& report);
+    // Weighted least squares, minimizing sum of weights[k] * residual[k]^2; empty weights are equal.
+    // Weights of another length than the instruments leave delta_ and pi_ as they are and set the
+    // report's status to ImproperInputParameters.
+    void calibrate(const std::vector<double>& market_times, const std::vector<double>& market_prices,
+                   const std::vector<double>& weights,
+                   const HoLeeCalibrationSettings& settings, HoLeeCalibrationReport& report);
+    void calibrate(const std::vector<double>& market_times, const std::vector<double>& market_prices,
+                   const std::vector<double>& weights,
+                   const HoLeeCalibrationSettings& settings, HoLeeCalibrationReport& report,
+                   HoLeeCalibrationWorkspace& workspace);
+    // Warm start from state, which must be for the same node and market times to be used. Skips the
+    // solve when the Gauss-Newton step from the previous solution against the new prices is within
+    // xtol; otherwise solves from the better of the previous solution and that step. Returns false
+    // when skipped, with the report's status RelativeErrorTooSmall and its residual norm at the
+    // previous solution. The model takes the result of every solve, but state only solves that
+    // converged, so it always holds the last converged one and the skip test measures every move
+    // since then.
+    bool recalibrate(const std::vector<double>& market_times, const std::vector<double>& market_prices,
+                     HoLeeCalibrationState& state, const HoLeeCalibrationSettings& settings,
+                     HoLeeCalibrationReport& report, HoLeeCalibrationWorkspace& workspace);
+    // Adjoint of the fitted (delta_, pi_) through the implicit function theorem at the least squares
+    // optimum: given the adjoints delta_bar and pi_bar of the parameters, returns the adjoints of
+    // log D(T_k + n dt) / D(n dt) and of market price k, to be carried back to whatever they depend on
+    void calibrationAdjoint(const std::vector<double>& market_times, const std::vector<double>& market_prices,
+                            const double& delta_bar, const double& pi_bar,
+                            std::vector<double>& log_forwards_bar, std::vector<double>& market_prices_bar) const;
+    // Same fit with the Jacobian of HoLeeZeroCouponModel by automatic differentiation
+    void calibrateAutoDiff(const std::vector<double>& market_times, const std::vector<double>& market_prices,
+                           const HoLeeCalibrationSettings& settings);
 
+private:
+    HoLeeLogHTable& logHTable() const;
 };
 
+// Zero coupon prices of node (n, i) minus market prices, generic over the scalar type of
+// x = (delta, pi) for AutoDiffCalibration.h. Sums the n - 1 terms of log d(T) directly rather than
+// reading HoLeeLogHTable, which holds doubles only, so every residual costs O(n) pow and log calls
+// against a few table reads in the analytic Jacobian of TermStructureHoLee::calibrate. Even when
+// the AutoDiff solve needs fewer evaluations, each one is slower than the analytic path's.
+struct HoLeeZeroCouponModel {
+    static const int max_parameters = 2;
+
+    const std::vector<double>& market_times;
+    const std::vector<double>& market_prices;
+    int n;
+    int i;
+    std::vector<double> periods; // market times in periods
+    std::vector<double> forward; // D(T + n dt) / D(n dt) at each market time
+
+    HoLeeZeroCouponModel(const TermStructureHoLee& model, const std::vector<double>& market_times,
+                         const std::vector<double>& market_prices);
+
+    int values() const { return int(market_times.size()); }
+
+    template <class Scalar>
+    static Scalar logH(const double& x, const Scalar& delta, const Scalar& pi) {
+        using std::log;
+        using std::pow;
+        return -log(pi + (1.0 - pi) * pow(delta, x));
+    }
+
+    template <class Scalar>
+    void residuals(const Scalar* x, const int& /*parameters*/, Scalar* fvec) const {
+        using std::exp;
+        using std::log;
+        Scalar whole = logH(double(n), x[0], x[1]);
+        for (int j = 1; j < n; ++j) whole -= logH(double(j), x[0], x[1]);
+        Scalar log_delta = log(x[0]);
+        for (size_t k = 0; k < market_times.size(); ++k) {
+            const double& T = periods[k];
+            Scalar log_factor = whole;
+            for (int j = 1; j < n; ++j) log_factor += logH(T + j, x[0], x[1]);
+            if (n != i) log_factor += T * (n - i) * log_delta;
+            fvec[k] = forward[k] * exp(log_factor) - market_prices[k];
+        }
+    }
+};
+
+// Calibration instrument selection. Each returns indices into the market vectors in ascending
+// order without duplicates; gatherInstruments copies the selected entries of any market vector.
+std::vector<size_t> selectInstrumentsByTenor(const std::vector<double>& market_times,
+                                             const std::vector<double>& tenors); // nearest to each tenor
+std::vector<size_t> selectInstrumentsLogSpaced(const std::vector<double>& market_times,
+                                               const size_t& count); // nearest to log-spaced maturities
+std::vector<size_t> selectInstrumentsByLiquidity(const std::vector<double>& liquidity,
+                                                 const size_t& count); // the count most liquid
+std::vector<double> gatherInstruments(const std::vector<double>& values, const std::vector<size_t>& indices);
+
 std::vector<std::vector<TermStructureHoLee>> buildTermStructureTree(TermStructure* initial, 
                                                                     const int& no_steps, 
                                                                     const double& delta, 
-                                                                    const double& pi);
+                                                                    const double& pi,
+                                                                    const double& dt = 1.0);
+
+// Recombining Ho-Lee lattice with steps of length dt. A node's one-period discount factor is
+// d(t, i) = a_t * delta^(t - i), a_t = A_t(1) the factor of the top node of step t, so the lattice
+// stores a_t per step and the powers of delta instead of every node: O(steps) memory, which keeps
+// thousands of steps cheap. Bond prices at the nodes of a step are evaluated from the closed form
+// d(T) = A_t(T) * delta^(T (t - i)), T in periods, one step at a time.
+// Curve is the initial term structure; a concrete (final) curve type binds its d() at compile
+// time, while the default goes through the virtual TermStructure interface. reset() rebuilds the
+// lattice in the storage of the previous one, so a reused lattice does not allocate once it has
+// held as many steps.
+template <class Curve = TermStructure>
+class HoLeeLattice {
+private:
+    const Curve* initial_term_;
+    int no_steps_;
+    double delta_;
+    double pi_;
+    double dt_;
+    std::vector<double> step_factors_; // a_t for every step
+    std::vector<double> step_factors_d_delta_; // d log a_t / d delta
+    std::vector<double> step_factors_d_pi_; // d log a_t / d pi
+    std::vector<double> delta_powers_; // delta^k for k = 0..no_steps - 1
+    mutable HoLeeLogHTable log_h_table_;
+    double logStepFactor(const int& t, const double& T) const; // log A_t(T), T in the curve's time unit
+public:
+    HoLeeLattice();
+    HoLeeLattice(const Curve* initial, const int& no_steps, const double& delta, const double& pi,
+                 const double& dt = 1.0);
+    void reset(const Curve* initial, const int& no_steps, const double& delta, const double& pi,
+               const double& dt = 1.0);
+
+    int steps() const { return no_steps_; }
+    double delta() const { return delta_; }
+    double pi() const { return pi_; }
+    double dt() const { return dt_; }
+
+    double oneP(const int& t, const int& i) const { return step_factors_[t] * delta_powers_[t - i]; }
+    double stepFactor(const int& t) const { return step_factors_[t]; }
+    double stepFactorLogDerivativeDelta(const int& t) const { return step_factors_d_delta_[t]; }
+    double stepFactorLogDerivativePi(const int& t) const { return step_factors_d_pi_[t]; }
+    const double* deltaPowers() const { return delta_powers_.data(); }
+
+    double d(const int& t, const int& i, const double& T) const; // discount factor for maturity T at node (t, i)
+    // log A_t(T) = log d(t, t, T) with its derivatives in delta and pi
+    double logStepFactor(const int& t, const double& T, double& d_delta, double& d_pi) const;
+    void bondPrices(const int& t,
+                    const std::vector<double>& cflow_times,
+                    const std::vector<double>& cflows,
+                    double* prices) const; // prices[i] for i = 0..t, cash flow times from step t
+    void bondPrices(const int& t,
+                    const std::vector<double>& cflow_times,
+                    const std::vector<double>& cflows,
+                    double* prices,
+                    double* d_delta,
+                    double* d_pi) const; // with the derivatives of each price in delta and pi
+};
+
+template <class Curve>
+HoLeeLattice<Curve>::HoLeeLattice()
+    : initial_term_(nullptr), no_steps_(0), delta_(1.0), pi_(0.0), dt_(1.0), log_h_table_(1.0, 0.0) {}
+
+template <class Curve>
+HoLeeLattice<Curve>::HoLeeLattice(const Curve* initial, const int& no_steps, const double& delta, const double& pi,
+                                  const double& dt)
+    : initial_term_(initial), no_steps_(0), delta_(delta), pi_(pi), dt_(dt), log_h_table_(delta, pi) {
+    reset(initial, no_steps, delta, pi, dt);
+}
+
+template <class Curve>
+void HoLeeLattice<Curve>::reset(const Curve* initial, const int& no_steps, const double& delta, const double& pi,
+                                const double& dt) {
+    initial_term_ = initial;
+    no_steps_ = no_steps;
+    delta_ = delta;
+    pi_ = pi;
+    dt_ = dt;
+    log_h_table_.reset(delta, pi);
+    step_factors_.resize(no_steps);
+    step_factors_d_delta_.resize(no_steps);
+    step_factors_d_pi_.resize(no_steps);
+    delta_powers_.resize(no_steps);
+    double log_delta = log_h_table_.logDelta();
+    for (int t = 0; t < no_steps_; ++t) {
+        step_factors_[t] = std::exp(logStepFactor(t, dt_, step_factors_d_delta_[t], step_factors_d_pi_[t]));
+        delta_powers_[t] = std::exp(t * log_delta);
+    }
+}
+
+template <class Curve>
+double HoLeeLattice<Curve>::logStepFactor(const int& t, const double& T) const {
+    double d_delta, d_pi;
+    return logStepFactor(t, T, d_delta, d_pi);
+}
+
+template <class Curve>
+double HoLeeLattice<Curve>::logStepFactor(const int& t, const double& T, double& d_delta, double& d_pi) const {
+    return std::log(initial_term_->d(T + t * dt_) / initial_term_->d(t * dt_))
+         + log_h_table_.logNodeFactor(t, t, hoLeePeriods(T, dt_), d_delta, d_pi);
+}
+
+template <class Curve>
+double HoLeeLattice<Curve>::d(const int& t, const int& i, const double& T) const {
+    return std::exp(logStepFactor(t, T) + hoLeePeriods(T, dt_) * (t - i) * log_h_table_.logDelta());
+}
+
+template <class Curve>
+void HoLeeLattice<Curve>::bondPrices(const int& t,
+                                     const std::vector<double>& cflow_times,
+                                     const std::vector<double>& cflows,
+                                     double* prices) const {
+    Eigen::Map<Eigen::ArrayXd> out(prices, t + 1);
+    out.setZero();
+    double log_delta = log_h_table_.logDelta();
+    for (size_t c = 0; c < cflow_times.size(); ++c) {
+        double log_up = hoLeePeriods(cflow_times[c], dt_) * log_delta;
+        out += cflows[c] * (logStepFactor(t, cflow_times[c]) + log_up * Eigen::ArrayXd::LinSpaced(t + 1, t, 0)).exp();
+    }
+}
+
+template <class Curve>
+void HoLeeLattice<Curve>::bondPrices(const int& t,
+                                     const std::vector<double>& cflow_times,
+                                     const std::vector<double>& cflows,
+                                     double* prices,
+                                     double* d_delta,
+                                     double* d_pi) const {
+    std::fill(prices, prices + t + 1, 0.0);
+    std::fill(d_delta, d_delta + t + 1, 0.0);
+    std::fill(d_pi, d_pi + t + 1, 0.0);
+    double log_delta = log_h_table_.logDelta();
+    for (size_t c = 0; c < cflow_times.size(); ++c) {
+        double periods = hoLeePeriods(cflow_times[c], dt_);
+        double log_a_d_delta, log_a_d_pi;
+        double log_a = logStepFactor(t, cflow_times[c], log_a_d_delta, log_a_d_pi);
+        for (int i = 0; i <= t; ++i) {
+            // d(T) = A_t(T) delta^(T (t - i))
+            double price = cflows[c] * std::exp(log_a + periods * (t - i) * log_delta);
+            prices[i] += price;
+            d_delta[i] += price * (log_a_d_delta + periods * (t - i) / delta_);
+            d_pi[i] += price * log_a_d_pi;
+        }
+    }
+}
 
 #endif // TERM_STRUCTURE_HO_LEE_H
\ No newline at end of file
@@ -0,0 +1,185 @@
+//TermStructureNelsonSiegel.cpp
+#include "TermStructureNelsonSiegel.h"
+#include "TermStructure.h"
+#include <cmath>
+#include <vector>
+#include "Eigen/Dense"
+#include "unsupported/Eigen/NonLinearOptimization"
+#include "AutoDiffCalibration.h"
+
+// Factor loadings L(x) = (1 - e^(-x)) / x and e^(-x) for x = t / tau, with L(0) = 1
+static void loadings(const Eigen::ArrayXd& t, const double& tau, Eigen::ArrayXd& L, Eigen::ArrayXd& decay) {
+    Eigen::ArrayXd x = t / tau;
+    decay = (-x).exp();
+    L = (x.abs() < 1e-8).select(1.0 - 0.5 * x, (1.0 - decay) / x);
+}
+
+TermStructureNelsonSiegel::TermStructureNelsonSiegel(const NelsonSiegelParams& params)
+    : params_(params.beta0, params.beta1, params.beta2, 0.0, params.tau, 1.0), svensson_(false) {}
+
+TermStructureNelsonSiegel::TermStructureNelsonSiegel(const SvenssonParams& params)
+    : params_(params), svensson_(true) {}
+
+TermStructureNelsonSiegel::~TermStructureNelsonSiegel() {}
+
+double TermStructureNelsonSiegel::r(const double& t) const {
+    double out;
+    TermStructureNelsonSiegel::r(&t, &out, 1);
+    return out;
+}
+
+double TermStructureNelsonSiegel::d(const double& t) const {
+    return discountFactorFromYield(r(t), t);
+}
+
+double TermStructureNelsonSiegel::f(const double& t1, const double& t2) const {
+    double d1 = d(t1);
+    double d2 = d(t2);
+    return forwardRateFromDiscountFactors(d1, d2, t2 - t1);
+}
+
+void TermStructureNelsonSiegel::r(const double* t, double* out, const size_t& n) const {
+    Eigen::Map<const Eigen::ArrayXd> times(t, n);
+    Eigen::ArrayXd L1, e1;
+    loadings(times, params_.tau1, L1, e1);
+    Eigen::Map<Eigen::ArrayXd> yields(out, n);
+    yields = params_.beta0 + params_.beta1 * L1 + params_.beta2 * (L1 - e1);
+    if (svensson_) {
+        Eigen::ArrayXd L2, e2;
+        loadings(times, params_.tau2, L2, e2);
+        yields += params_.beta3 * (L2 - e2);
+    }
+}
+
+void TermStructureNelsonSiegel::d(const double* t, double* out, const size_t& n) const {
+    TermStructureNelsonSiegel::r(t, out, n);
+    Eigen::Map<Eigen::ArrayXd> yields(out, n);
+    yields = (-yields * Eigen::Map<const Eigen::ArrayXd>(t, n)).exp();
+}
+
+Eigen::VectorXd TermStructureNelsonSiegel::parameterVector() const {
+    Eigen::VectorXd x(svensson_ ? 6 : 4);
+    x[0] = params_.beta0;
+    x[1] = params_.beta1;
+    x[2] = params_.beta2;
+    x[3] = params_.tau1;
+    if (svensson_) {
+        x[4] = params_.beta3;
+        x[5] = params_.tau2;
+    }
+    return x;
+}
+
+void TermStructureNelsonSiegel::setParameterVector(const Eigen::VectorXd& x) {
+    params_.beta0 = x[0];
+    params_.beta1 = x[1];
+    params_.beta2 = x[2];
+    params_.tau1 = x[3];
+    if (svensson_) {
+        params_.beta3 = x[4];
+        params_.tau2 = x[5];
+    }
+}
+
+void TermStructureNelsonSiegel::jacobian(const double* t, const size_t& n, Eigen::MatrixXd& jac) const {
+    // dL/dtau = (L - e) / tau and de/dtau = e x / tau with x = t / tau
+    Eigen::Map<const Eigen::ArrayXd> times(t, n);
+    jac.resize(n, svensson_ ? 6 : 4);
+    Eigen::ArrayXd L1, e1;
+    loadings(times, params_.tau1, L1, e1);
+    Eigen::ArrayXd hump1 = L1 - e1;
+    jac.col(0).setOnes();
+    jac.col(1) = L1.matrix();
+    jac.col(2) = hump1.matrix();
+    jac.col(3) = ((params_.beta1 + params_.beta2) * hump1 / params_.tau1
+                  - params_.beta2 * e1 * times / (params_.tau1 * params_.tau1)).matrix();
+    if (svensson_) {
+        Eigen::ArrayXd L2, e2;
+        loadings(times, params_.tau2, L2, e2);
+        Eigen::ArrayXd hump2 = L2 - e2;
+        jac.col(4) = hump2.matrix();
+        jac.col(5) = (params_.beta3 * (hump2 / params_.tau2 - e2 * times / (params_.tau2 * params_.tau2))).matrix();
+    }
+}
+
+// Functor for Levenberg-Marquardt algorithm, residuals are model minus observed yields
+struct NelsonSiegelFunctor {
+    TermStructureNelsonSiegel& model;
+    const std::vector<double>& times;
+    const std::vector<double>& yields;
+
+    NelsonSiegelFunctor(TermStructureNelsonSiegel& model, const std::vector<double>& times, const std::vector<double>& yields)
+        : model(model), times(times), yields(yields) {}
+
+    int operator()(const Eigen::VectorXd& x, Eigen::VectorXd& fvec) const {
+        model.setParameterVector(x);
+        model.r(times.data(), fvec.data(), times.size());
+        fvec -= Eigen::Map<const Eigen::VectorXd>(yields.data(), yields.size());
+        return 0;
+    }
+
+    int df(const Eigen::VectorXd& x, Eigen::MatrixXd& fjac) const {
+        model.setParameterVector(x);
+        model.jacobian(times.data(), times.size(), fjac);
+        return 0;
+    }
+
+    int inputs() const { return int(model.parameterVector().size()); }
+    int values() const { return int(times.size()); }
+};
+
+static TermStructureNelsonSiegel fitNelsonSiegel(TermStructureNelsonSiegel model,
+                                                 const std::vector<double>& times, const std::vector<double>& yields,
+                                                 int* status) {
+    Eigen::VectorXd x = model.parameterVector();
+    if (times.size() != yields.size() || times.size() < size_t(x.size())) {
+        if (status) *status = Eigen::LevenbergMarquardtSpace::ImproperInputParameters;
+        return model;
+    }
+
+    NelsonSiegelFunctor functor(model, times, yields);
+    Eigen::LevenbergMarquardt<NelsonSiegelFunctor> lm(functor);
+    int result = lm.minimize(x);
+    if (status) *status = result;
+
+    model.setParameterVector(x);
+    return model;
+}
+
+TermStructureNelsonSiegel TermStructureNelsonSiegel::fit(const std::vector<double>& times, const std::vector<double>& yields,
+                                                         const NelsonSiegelParams& guess, int* status) {
+    return fitNelsonSiegel(TermStructureNelsonSiegel(guess), times, yields, status);
+}
+
+TermStructureNelsonSiegel TermStructureNelsonSiegel::fit(const std::vector<double>& times, const std::vector<double>& yields,
+                                                         const SvenssonParams& guess, int* status) {
+    return fitNelsonSiegel(TermStructureNelsonSiegel(guess), times, yields, status);
+}
+
+static TermStructureNelsonSiegel fitNelsonSiegelAutoDiff(TermStructureNelsonSiegel model,
+                                                         const std::vector<double>& times, const std::vector<double>& yields,
+                                                         int* status) {
+    Eigen::VectorXd x = model.parameterVector();
+    if (times.size() != yields.size() || times.size() < size_t(x.size())) {
+        if (status) *status = Eigen::LevenbergMarquardtSpace::ImproperInputParameters;
+        return model;
+    }
+
+    NelsonSiegelYieldModel residuals(times, yields);
+    Eigen::LevenbergMarquardt<NelsonSiegelFunctor>::Parameters defaults;
+    int result = calibrateAutoDiff(residuals, x, defaults.ftol, defaults.xtol, defaults.maxfev);
+    if (status) *status = result;
+
+    model.setParameterVector(x);
+    return model;
+}
+
+TermStructureNelsonSiegel TermStructureNelsonSiegel::fitAutoDiff(const std::vector<double>& times, const std::vector<double>& yields,
+                                                                 const NelsonSiegelParams& guess, int* status) {
+    return fitNelsonSiegelAutoDiff(TermStructureNelsonSiegel(guess), times, yields, status);
+}
+
+TermStructureNelsonSiegel TermStructureNelsonSiegel::fitAutoDiff(const std::vector<double>& times, const std::vector<double>& yields,
+                                                                 const SvenssonParams& guess, int* status) {
+    return fitNelsonSiegelAutoDiff(TermStructureNelsonSiegel(guess), times, yields, status);
+}
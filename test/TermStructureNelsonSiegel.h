@@ -0,0 +1,102 @@
+//TermStructureNelsonSiegel.h
+#ifndef TERM_STRUCTURE_NELSON_SIEGEL_H
+#define TERM_STRUCTURE_NELSON_SIEGEL_H
+
+#include "TermStructure.h"
+#include <vector>
+#include "Eigen/Dense"
+
+// Nelson-Siegel yield curve, or its Svensson extension with a second hump (beta3, tau2):
+// r(t) = beta0 + beta1 L(t/tau1) + beta2 (L(t/tau1) - e^(-t/tau1)) + beta3 (L(t/tau2) - e^(-t/tau2)),
+// L(x) = (1 - e^(-x)) / x. Grids are evaluated with Eigen arrays in one pass.
+class TermStructureNelsonSiegel final : public TermStructure {
+public:
+    struct SvenssonParams {
+        double beta0;
+        double beta1;
+        double beta2;
+        double beta3;
+        double tau1;
+        double tau2;
+
+        SvenssonParams(double b0, double b1, double b2, double b3, double t1, double t2)
+            : beta0(b0), beta1(b1), beta2(b2), beta3(b3), tau1(t1), tau2(t2) {}
+    };
+
+private:
+    SvenssonParams params_;
+    bool svensson_;
+public:
+    TermStructureNelsonSiegel(const NelsonSiegelParams& params);
+    TermStructureNelsonSiegel(const SvenssonParams& params);
+    virtual ~TermStructureNelsonSiegel();
+    using TermStructure::r;
+    using TermStructure::d;
+    virtual double r(const double& t) const override;
+    virtual double d(const double& t) const override;
+    virtual double f(const double& t1, const double& t2) const override;
+    virtual void r(const double* t, double* out, const size_t& n) const override;
+    virtual void d(const double* t, double* out, const size_t& n) const override;
+
+    bool isSvensson() const { return svensson_; }
+    const SvenssonParams& params() const { return params_; }
+    Eigen::VectorXd parameterVector() const; // beta0, beta1, beta2, tau1 (+ beta3, tau2 for Svensson)
+    void setParameterVector(const Eigen::VectorXd& x);
+
+    // Yields and their derivatives with respect to parameterVector() at each time
+    void jacobian(const double* t, const size_t& n, Eigen::MatrixXd& jac) const;
+
+    // Least squares fit of the yields observed at times, started from the given parameters. status,
+    // when given, receives the Eigen::LevenbergMarquardtSpace::Status of the solve (1 to 4 when it
+    // converged); times and yields of different lengths or fewer than the parameters leave the guess
+    // and give ImproperInputParameters.
+    static TermStructureNelsonSiegel fit(const std::vector<double>& times, const std::vector<double>& yields,
+                                         const NelsonSiegelParams& guess, int* status = nullptr);
+    static TermStructureNelsonSiegel fit(const std::vector<double>& times, const std::vector<double>& yields,
+                                         const SvenssonParams& guess, int* status = nullptr);
+    // Same fits with the Jacobian of NelsonSiegelYieldModel by automatic differentiation
+    static TermStructureNelsonSiegel fitAutoDiff(const std::vector<double>& times, const std::vector<double>& yields,
+                                                 const NelsonSiegelParams& guess, int* status = nullptr);
+    static TermStructureNelsonSiegel fitAutoDiff(const std::vector<double>& times, const std::vector<double>& yields,
+                                                 const SvenssonParams& guess, int* status = nullptr);
+};
+
+// Model minus observed yields, generic over the scalar type of the parameterVector() layout
+// (4 parameters for Nelson-Siegel, 6 for Svensson) for AutoDiffCalibration.h
+struct NelsonSiegelYieldModel {
+    static const int max_parameters = 6;
+
+    const std::vector<double>& times;
+    const std::vector<double>& yields;
+
+    NelsonSiegelYieldModel(const std::vector<double>& times, const std::vector<double>& yields)
+        : times(times), yields(yields) {}
+
+    int values() const { return int(times.size()); }
+
+    // Hump loading L(t / tau) - e^(-t / tau); the level loading is returned in L
+    template <class Scalar>
+    static Scalar hump(const double& t, const Scalar& tau, Scalar& L) {
+        using std::exp;
+        if (t == 0) {
+            L = Scalar(1.0);
+            return Scalar(0.0);
+        }
+        Scalar x = t / tau;
+        Scalar decay = exp(-x);
+        L = (1.0 - decay) / x;
+        return L - decay;
+    }
+
+    template <class Scalar>
+    void residuals(const Scalar* x, const int& parameters, Scalar* fvec) const {
+        for (size_t k = 0; k < times.size(); ++k) {
+            Scalar L1, L2;
+            fvec[k] = x[0] + x[2] * hump(times[k], x[3], L1) - yields[k];
+            fvec[k] += x[1] * L1;
+            if (parameters == 6) fvec[k] += x[4] * hump(times[k], x[5], L2);
+        }
+    }
+};
+
+#endif // TERM_STRUCTURE_NELSON_SIEGEL_H
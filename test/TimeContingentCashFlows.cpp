@@ -1,34 +1,467 @@
 //TimeContingentCashFlows.cpp
 #include "TimeContingentCashFlows.h"
 #include "TermStructureHoLee.h"
+#include "HoLeeCalibrationCache.h"
+#include "HoLeeMonteCarlo.h"
 #include "TermStructure.h"
+#include "TermStructureCubicSpline.h"
+#include "TermStructureNelsonSiegel.h"
 #include <algorithm>
 #include <vector>
 #include <iostream>
+#include <chrono>
+#include <cmath>
+#include <limits>
 
+// Step k holds the flows still due after k steps of length dt, at their times from that step.
+// The times are taken from the initial ones at every step rather than decremented step by step,
+// so a flow on the grid lands exactly on zero at its own step however many steps precede it.
 std::vector<TimeContingentCashFlows> build_time_series_of_bond_time_contingent_cash_flows(const std::vector<double>& initial_times, 
-                                                                                          const std::vector<double>& initial_cflows) {
+                                                                                          const std::vector<double>& initial_cflows,
+                                                                                          const double& dt) {
     std::vector<TimeContingentCashFlows> vec_cf;
+    std::vector<double> periods(initial_times.size());
+    for (size_t i = 0; i < initial_times.size(); ++i) periods[i] = hoLeePeriods(initial_times[i], dt);
     std::vector<double> times = initial_times;
     std::vector<double> cflows = initial_cflows;
 
-    while (times.size() > 0) {
+    for (int k = 1; times.size() > 0; ++k) {
         vec_cf.push_back(TimeContingentCashFlows(times, cflows));
-        std::vector<double> tmp_times;
-        std::vector<double> tmp_cflows;
-        for (int i = 0; i < times.size(); ++i) {
-            if (times[i] - 1.0 >= 0.0) {
-                tmp_times.push_back(times[i] - 1.0);
-                tmp_cflows.push_back(cflows[i]);
+        times.clear();
+        cflows.clear();
+        for (size_t i = 0; i < initial_times.size(); ++i) {
+            if (periods[i] >= k) {
+                times.push_back(periods[i] == k ? 0.0 : initial_times[i] - k * dt);
+                cflows.push_back(initial_cflows[i]);
             }
         }
-        times = tmp_times;
-        cflows = tmp_cflows;
     }
 
     return vec_cf;
 }
 
+HoLeeExerciseBoundary::HoLeeExerciseBoundary(const int& step, const double& time, const int& node, const double& bond_price)
+    : step(step), time(time), node(node), bond_price(bond_price) {}
+
+HoLeeGreeks::HoLeeGreeks()
+    : delta(0.0), gamma(0.0), theta(0.0), ho_lee_delta(0.0), ho_lee_pi(0.0), branching_pi(0.0) {}
+
+HoLeePricingReport::HoLeePricingReport()
+    : lattice_steps(0), lattice_ms(0.0), induction_ms(0.0) {}
+
+static double elapsed_milliseconds(const std::chrono::steady_clock::time_point& start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Backward induction for the European call, templated on the initial curve so the lattice
+// binds the curve's d() at compile time. The lattice and the option values live in per-thread
+// storage reused across calls, and each step overwrites the values of the step after it in
+// place, so pricing does not allocate once a thread has priced an option this long.
+// With greeks, the same induction carries the derivatives of every node value (forward mode) in the
+// calibrated delta and pi of the discount factors and in the branching probability pi, and keeps
+// the values of steps 1 and 2 for the finite-difference Greeks.
+template <class Curve>
+static double price_european_call_on_ho_lee_lattice(const Curve* initial,
+    const double& calibrated_delta,
+    const double& calibrated_pi,
+    const double& pi,
+    const std::vector<TimeContingentCashFlows>& vec_cf,
+    const double& K,
+    const int& T,
+    const double& dt,
+    HoLeePricingReport* report,
+    HoLeeGreeks* greeks) {
+
+    static thread_local HoLeeLattice<Curve> lattice;
+    static thread_local std::vector<double> values;
+    static thread_local std::vector<double> d_delta;
+    static thread_local std::vector<double> d_pi;
+    static thread_local std::vector<double> d_branching_pi;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    lattice.reset(initial, T + 1, calibrated_delta, calibrated_pi, dt);
+
+    const TimeContingentCashFlows& expiry_cflows = vec_cf[T];
+    values.resize(T + 1);
+    if (greeks) {
+        d_delta.resize(T + 1);
+        d_pi.resize(T + 1);
+        d_branching_pi.assign(T + 1, 0.0);
+        lattice.bondPrices(T, expiry_cflows.times, expiry_cflows.cash_flows, values.data(), d_delta.data(), d_pi.data());
+    } else {
+        lattice.bondPrices(T, expiry_cflows.times, expiry_cflows.cash_flows, values.data());
+    }
+    for (int i = 0; i <= T; ++i) {
+        if (greeks && values[i] <= K) d_delta[i] = d_pi[i] = 0.0;
+        values[i] = std::max(0.0, values[i] - K); // Call payoffs at maturity
+    }
+    if (report) {
+        report->lattice_steps = T + 1;
+        report->lattice_ms = elapsed_milliseconds(start);
+    }
+
+    start = std::chrono::steady_clock::now();
+    const double* delta_powers = lattice.deltaPowers();
+    if (!greeks) {
+        for (int t = T - 1; t >= 0; --t) {
+            // values[i + 1] is still the step t + 1 value when values[i] is overwritten
+            // d(t, i) = a_t * delta^(t - i)
+            const double step_factor = lattice.stepFactor(t);
+            for (int i = 0; i <= t; ++i) {
+                values[i] = (pi * values[i + 1] + (1.0 - pi) * values[i]) * step_factor * delta_powers[t - i];
+            }
+        }
+        if (report) report->induction_ms = elapsed_milliseconds(start);
+        return values[0];
+    }
+
+    double step1[2] = { 0.0, 0.0 }, step2[3] = { 0.0, 0.0, 0.0 };
+    if (T == 2) std::copy(values.begin(), values.begin() + 3, step2);
+    for (int t = T - 1; t >= 0; --t) {
+        const double step_factor = lattice.stepFactor(t);
+        const double log_d_delta = lattice.stepFactorLogDerivativeDelta(t);
+        const double log_d_pi = lattice.stepFactorLogDerivativePi(t);
+        for (int i = 0; i <= t; ++i) {
+            // V = (pi V_up + (1 - pi) V_down) d, d = a_t delta^(t - i)
+            const double d = step_factor * delta_powers[t - i];
+            const double continuation = pi * values[i + 1] + (1.0 - pi) * values[i];
+            d_delta[i] = (pi * d_delta[i + 1] + (1.0 - pi) * d_delta[i]) * d
+                       + continuation * d * (log_d_delta + (t - i) / calibrated_delta);
+            d_pi[i] = (pi * d_pi[i + 1] + (1.0 - pi) * d_pi[i]) * d + continuation * d * log_d_pi;
+            d_branching_pi[i] = (pi * d_branching_pi[i + 1] + (1.0 - pi) * d_branching_pi[i]
+                                 + values[i + 1] - values[i]) * d;
+            values[i] = continuation * step_factor * delta_powers[t - i];
+        }
+        if (t == 2) std::copy(values.begin(), values.begin() + 3, step2);
+        if (t == 1) std::copy(values.begin(), values.begin() + 2, step1);
+    }
+    if (report) report->induction_ms = elapsed_milliseconds(start);
+
+    greeks->ho_lee_delta = d_delta[0];
+    greeks->ho_lee_pi = d_pi[0];
+    greeks->branching_pi = d_branching_pi[0];
+    // Not available without steps 1 and 2 before expiry
+    greeks->delta = greeks->gamma = greeks->theta = std::numeric_limits<double>::quiet_NaN();
+    if (T >= 2) {
+        // Bond prices at the nodes of steps 1 and 2, with the cash flows still due from each step.
+        // A difference quotient over nodes whose bond prices coincide is left at zero.
+        greeks->delta = greeks->gamma = 0.0;
+        double bond1[2], bond2[3];
+        lattice.bondPrices(1, vec_cf[1].times, vec_cf[1].cash_flows, bond1);
+        lattice.bondPrices(2, vec_cf[2].times, vec_cf[2].cash_flows, bond2);
+        if (bond1[1] != bond1[0]) greeks->delta = (step1[1] - step1[0]) / (bond1[1] - bond1[0]);
+        if (bond2[2] != bond2[1] && bond2[1] != bond2[0] && bond2[2] != bond2[0]) {
+            double delta_up = (step2[2] - step2[1]) / (bond2[2] - bond2[1]);
+            double delta_down = (step2[1] - step2[0]) / (bond2[1] - bond2[0]);
+            greeks->gamma = (delta_up - delta_down) / (0.5 * (bond2[2] - bond2[0]));
+        }
+        greeks->theta = (step2[1] - values[0]) / (2.0 * dt);
+    }
+    return values[0];
+}
+
+// Backward induction for a ladder of European options expiring at step T. The values of every
+// node are stored strike-major, one column of S calls (and S puts) per node, so each step is a
+// contiguous vectorized update of whole columns with the node's one-period discount factor.
+// Bond prices at expiry are computed once for every strike. Storage is per thread and reused.
+template <class Curve>
+static void price_european_options_on_ho_lee_lattice(const Curve* initial,
+    const double& calibrated_delta,
+    const double& calibrated_pi,
+    const double& pi,
+    const TimeContingentCashFlows& expiry_cflows,
+    const std::vector<double>& strikes,
+    const bool& puts,
+    const int& T,
+    const double& dt,
+    HoLeePricingReport* report,
+    double* prices) {
+
+    static thread_local HoLeeLattice<Curve> lattice;
+    static thread_local std::vector<double> bond_prices;
+    static thread_local std::vector<double> values;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    lattice.reset(initial, T + 1, calibrated_delta, calibrated_pi, dt);
+
+    const Eigen::Index S = Eigen::Index(strikes.size());
+    const Eigen::Index rows = puts ? 2 * S : S;
+    bond_prices.resize(T + 1);
+    values.resize(size_t(rows) * (T + 1));
+    lattice.bondPrices(T, expiry_cflows.times, expiry_cflows.cash_flows, bond_prices.data());
+    Eigen::Map<const Eigen::ArrayXd> K(strikes.data(), S);
+    Eigen::Map<Eigen::ArrayXXd> v(values.data(), rows, T + 1);
+    for (int i = 0; i <= T; ++i) {
+        v.col(i).head(S) = (bond_prices[i] - K).max(0.0); // Call payoffs at maturity
+        if (puts) v.col(i).tail(S) = (K - bond_prices[i]).max(0.0);
+    }
+    if (report) {
+        report->lattice_steps = T + 1;
+        report->lattice_ms = elapsed_milliseconds(start);
+    }
+
+    start = std::chrono::steady_clock::now();
+    for (int t = T - 1; t >= 0; --t) {
+        const double step_factor = lattice.stepFactor(t);
+        const double* delta_powers = lattice.deltaPowers();
+        for (int i = 0; i <= t; ++i) {
+            v.col(i) = (pi * v.col(i + 1) + (1.0 - pi) * v.col(i)) * (step_factor * delta_powers[t - i]);
+        }
+    }
+    if (report) report->induction_ms = elapsed_milliseconds(start);
+
+    std::copy(values.begin(), values.begin() + rows, prices);
+}
+
+// Backward induction for a Bermudan option. At an exercise step the bond prices of the step's
+// nodes are computed first, then each node takes the larger of its continuation and exercise
+// values in the same loop that discounts it, so exercise costs no extra pass over the values.
+// exercisable[t] marks the exercise steps; step T always is.
+template <class Curve>
+static double price_bermudan_option_on_ho_lee_lattice(const Curve* initial,
+    const double& calibrated_delta,
+    const double& calibrated_pi,
+    const double& pi,
+    const std::vector<TimeContingentCashFlows>& vec_cf,
+    const BondOptionType& type,
+    const double& K,
+    const std::vector<char>& exercisable,
+    const int& T,
+    const double& dt,
+    std::vector<HoLeeExerciseBoundary>* boundaries,
+    HoLeePricingReport* report) {
+
+    static thread_local HoLeeLattice<Curve> lattice;
+    static thread_local std::vector<double> values;
+    static thread_local std::vector<double> bond_prices;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    lattice.reset(initial, T + 1, calibrated_delta, calibrated_pi, dt);
+    values.resize(T + 1);
+    bond_prices.resize(T + 1);
+    if (report) {
+        report->lattice_steps = T + 1;
+        report->lattice_ms = elapsed_milliseconds(start);
+    }
+
+    start = std::chrono::steady_clock::now();
+    const double sign = type == BondOptionType::Call ? 1.0 : -1.0;
+    if (boundaries) boundaries->clear();
+    for (int t = T; t >= 0; --t) {
+        if (!exercisable[t] && t < T) {
+            // values[i + 1] is still the step t + 1 value when values[i] is overwritten
+            const double step_factor = lattice.stepFactor(t);
+            const double* delta_powers = lattice.deltaPowers();
+            for (int i = 0; i <= t; ++i) {
+                values[i] = (pi * values[i + 1] + (1.0 - pi) * values[i]) * step_factor * delta_powers[t - i];
+            }
+            continue;
+        }
+
+        // Bond prices at the step; the bond is worth nothing once its last cash flow is paid
+        if (t < int(vec_cf.size())) lattice.bondPrices(t, vec_cf[t].times, vec_cf[t].cash_flows, bond_prices.data());
+        else std::fill(bond_prices.begin(), bond_prices.begin() + t + 1, 0.0);
+
+        int first_exercised = -1, last_exercised = -1;
+        const double step_factor = t < T ? lattice.stepFactor(t) : 0.0;
+        const double* delta_powers = lattice.deltaPowers();
+        for (int i = 0; i <= t; ++i) {
+            double continuation = t < T
+                ? (pi * values[i + 1] + (1.0 - pi) * values[i]) * step_factor * delta_powers[t - i]
+                : 0.0;
+            double exercise = sign * (bond_prices[i] - K);
+            if (exercise > continuation) {
+                values[i] = exercise;
+                if (first_exercised < 0) first_exercised = i;
+                last_exercised = i;
+            } else {
+                values[i] = continuation;
+            }
+        }
+        if (boundaries) {
+            int node = type == BondOptionType::Call ? first_exercised : last_exercised;
+            boundaries->push_back(HoLeeExerciseBoundary(t, t * dt, node, node < 0 ? 0.0 : bond_prices[node]));
+        }
+    }
+    if (boundaries) std::reverse(boundaries->begin(), boundaries->end());
+    if (report) report->induction_ms = elapsed_milliseconds(start);
+
+    return values[0];
+}
+
+// Backward induction for a bond with embedded options over steps 0..N. step_cflows[t] is paid at
+// step t; after it the bond is worth its discounted continuation, capped at call_levels[t] when
+// the issuer calls and floored at put_levels[t] when the holder puts. The straight bond is
+// discounted in the same loop.
+template <class Curve>
+static double price_callable_bond_on_ho_lee_lattice(const Curve* initial,
+    const double& calibrated_delta,
+    const double& calibrated_pi,
+    const double& pi,
+    const std::vector<double>& step_cflows,
+    const std::vector<double>& call_levels,
+    const std::vector<double>& put_levels,
+    const int& N,
+    const double& dt,
+    double* straight_bond_price,
+    HoLeePricingReport* report) {
+
+    static thread_local HoLeeLattice<Curve> lattice;
+    static thread_local std::vector<double> values;
+    static thread_local std::vector<double> straight;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    lattice.reset(initial, N, calibrated_delta, calibrated_pi, dt);
+    values.assign(N + 1, step_cflows[N]);
+    straight.assign(N + 1, step_cflows[N]);
+    if (report) {
+        report->lattice_steps = N + 1;
+        report->lattice_ms = elapsed_milliseconds(start);
+    }
+
+    start = std::chrono::steady_clock::now();
+    for (int t = N - 1; t >= 0; --t) {
+        const double step_factor = lattice.stepFactor(t);
+        const double* delta_powers = lattice.deltaPowers();
+        for (int i = 0; i <= t; ++i) {
+            const double d = step_factor * delta_powers[t - i];
+            double continuation = (pi * values[i + 1] + (1.0 - pi) * values[i]) * d;
+            values[i] = step_cflows[t] + std::max(put_levels[t], std::min(continuation, call_levels[t]));
+            straight[i] = step_cflows[t] + (pi * straight[i + 1] + (1.0 - pi) * straight[i]) * d;
+        }
+    }
+    if (report) report->induction_ms = elapsed_milliseconds(start);
+
+    if (straight_bond_price) *straight_bond_price = straight[0];
+    return values[0];
+}
+
+// Discounted payoff of an average price option for a block of Monte Carlo paths. bond_prices[k]
+// holds the bond price at every node of averaging step steps[k].
+struct AveragePriceOptionPayoff {
+    const std::vector<int>& steps;
+    const std::vector<std::vector<double>>& bond_prices;
+    double sign; // 1 for a call, -1 for a put
+    double K;
+    int expiry;
+
+    void operator()(const int& count, const int* nodes, const double* discounts, double* values) const {
+        std::fill(values, values + count, 0.0);
+        for (size_t k = 0; k < steps.size(); ++k) {
+            const int* step_nodes = nodes + size_t(steps[k]) * count;
+            const double* prices = bond_prices[k].data();
+            for (int p = 0; p < count; ++p) values[p] += prices[step_nodes[p]];
+        }
+        const double* expiry_discounts = discounts + size_t(expiry) * count;
+        const double scale = 1.0 / double(steps.size());
+        for (int p = 0; p < count; ++p) {
+            values[p] = expiry_discounts[p] * std::max(0.0, sign * (values[p] * scale - K));
+        }
+    }
+};
+
+// Monte Carlo for the average price option, with the lattice European price of the same option
+// on the bond at expiry as the control
+template <class Curve>
+static double price_average_price_option_on_ho_lee_paths(const Curve* initial,
+    const double& calibrated_delta,
+    const double& calibrated_pi,
+    const double& pi,
+    const std::vector<TimeContingentCashFlows>& vec_cf,
+    const BondOptionType& type,
+    const double& K,
+    const std::vector<int>& averaging_steps,
+    const int& T,
+    const double& dt,
+    const HoLeeMonteCarloSettings& monte_carlo,
+    HoLeeMonteCarloResult* result,
+    HoLeePricingReport* report) {
+
+    static thread_local HoLeeLattice<Curve> lattice;
+    static thread_local HoLeeMonteCarlo engine;
+
+    // The control's lattice price comes first; its lattice and induction times go to the report
+    const bool puts = type == BondOptionType::Put;
+    const std::vector<double> strikes(1, K);
+    double european[2] = { 0.0, 0.0 };
+    if (T < int(vec_cf.size())) {
+        price_european_options_on_ho_lee_lattice(initial, calibrated_delta, calibrated_pi, pi, vec_cf[T], strikes, puts,
+                                                 T, dt, report, european);
+    }
+
+    lattice.reset(initial, T + 1, calibrated_delta, calibrated_pi, dt);
+    std::vector<std::vector<double>> bond_prices(averaging_steps.size());
+    for (size_t k = 0; k < averaging_steps.size(); ++k) {
+        const int& t = averaging_steps[k];
+        bond_prices[k].assign(t + 1, 0.0); // the bond is worth nothing once its last cash flow is paid
+        if (t < int(vec_cf.size())) lattice.bondPrices(t, vec_cf[t].times, vec_cf[t].cash_flows, bond_prices[k].data());
+    }
+    const double sign = puts ? -1.0 : 1.0;
+    std::vector<double> control_payoffs(T + 1, 0.0);
+    if (T < int(vec_cf.size())) {
+        lattice.bondPrices(T, vec_cf[T].times, vec_cf[T].cash_flows, control_payoffs.data());
+        for (double& payoff : control_payoffs) payoff = std::max(0.0, sign * (payoff - K));
+    }
+
+    engine.reset(lattice, pi);
+    AveragePriceOptionPayoff payoff = { averaging_steps, bond_prices, sign, K, T };
+    HoLeeMonteCarloResult estimate = engine.simulate(payoff, control_payoffs, european[puts ? 1 : 0], monte_carlo);
+    if (result) *result = estimate;
+    if (report) report->lattice_steps = T + 1;
+    return estimate.price;
+}
+
+// Calls pricer with initial cast to its concrete curve type, so lattices built inside bind the
+// curve's d() at compile time; unknown curve types go through the virtual interface
+template <class Pricer>
+static auto with_concrete_curve(TermStructure* initial, const Pricer& pricer) {
+    if (const TermStructureInterpolated* curve = dynamic_cast<const TermStructureInterpolated*>(initial)) {
+        return pricer(curve);
+    }
+    if (const TermStructureCubicSpline* curve = dynamic_cast<const TermStructureCubicSpline*>(initial)) {
+        return pricer(curve);
+    }
+    if (const TermStructureNelsonSiegel* curve = dynamic_cast<const TermStructureNelsonSiegel*>(initial)) {
+        return pricer(curve);
+    }
+    if (const TermStructureFlat* curve = dynamic_cast<const TermStructureFlat*>(initial)) {
+        return pricer(curve);
+    }
+    return pricer(static_cast<const TermStructure*>(initial));
+}
+
+// Calibrates the Ho-Lee model at node (T + 1, 0) of a lattice with steps of dt. delta is given
+// for steps of one time unit; log delta scales with dt^(3/2) at a fixed short rate volatility,
+// which keeps the starting point as good at short steps.
+static TermStructureHoLee calibrate_ho_lee_for_expiry(const TermStructure* initial,
+    const double& delta,
+    const double& pi,
+    const int& T,
+    const double& dt,
+    const std::vector<double>& market_times,
+    const std::vector<double>& market_prices,
+    const HoLeeCalibrationSettings& settings,
+    HoLeeCalibrationCache* cache,
+    HoLeePricingReport* report) {
+
+    TermStructureHoLee ho_lee_model(initial, T + 1, 0, std::pow(delta, std::pow(dt, 1.5)), pi, dt);
+    HoLeeCalibrationReport calibration;
+    if (cache) cache->calibrate(ho_lee_model, market_times, market_prices, settings, calibration);
+    else ho_lee_model.calibrate(market_times, market_prices, settings, calibration);
+    if (report) report->calibration = calibration;
+    return ho_lee_model;
+}
+
+int ho_lee_expiry_step(const double& option_time_to_maturity, const double& dt) {
+    return int(option_time_to_maturity / dt + 0.0001);
+}
+
+std::vector<int> ho_lee_exercise_steps(const std::vector<double>& exercise_times, const double& dt) {
+    std::vector<int> steps;
+    for (const double& time : exercise_times) steps.push_back(int(std::floor(time / dt + 0.5)));
+    return steps;
+}
+
 double price_european_call_option_on_bond_using_ho_lee(TermStructure* initial,
     const double& delta,
     const double& pi,
@@ -37,56 +470,366 @@ double price_european_call_option_on_bond_using_ho_lee(TermStructure* initial,
     const double& K,
     const double& option_time_to_maturity,
     const std::vector<double>& market_times,
-    const std::vector<double>& market_prices) {
+    const std::vector<double>& market_prices,
+    const HoLeeCalibrationSettings& settings,
+    HoLeeCalibrationCache* cache,
+    HoLeePricingReport* report,
+    const double& dt,
+    HoLeeGreeks* greeks) {
 
-    int T = int(option_time_to_maturity + 0.0001);
+    int T = ho_lee_expiry_step(option_time_to_maturity, dt);
 
     // Calibrate the Ho-Lee model
-    TermStructureHoLee ho_lee_model(initial, T + 1, 0, delta, pi);
-    ho_lee_model.calibrate(market_times, market_prices);
+    TermStructureHoLee ho_lee_model = calibrate_ho_lee_for_expiry(initial, delta, pi, T, dt, market_times, market_prices,
+                                                                  settings, cache, report);
     double calibrated_delta = ho_lee_model.delta_;
     double calibrated_pi = ho_lee_model.pi_;
 
-    // Build the term structure tree using calibrated parameters
-    auto hl_tree = buildTermStructureTree(initial, T + 1, calibrated_delta, calibrated_pi);
-    auto vec_cf = build_time_series_of_bond_time_contingent_cash_flows(underlying_bond_cflow_times, underlying_bond_cflows);
+    auto vec_cf = build_time_series_of_bond_time_contingent_cash_flows(underlying_bond_cflow_times, underlying_bond_cflows, dt);
+    if (T >= int(vec_cf.size())) { // every cash flow is paid before expiry
+        if (greeks) *greeks = HoLeeGreeks();
+        return 0.0;
+    }
+
+    // Build the term structure lattice using calibrated parameters, specialized on the curve type
+    return with_concrete_curve(initial, [&](const auto* curve) {
+        return price_european_call_on_ho_lee_lattice(curve, calibrated_delta, calibrated_pi, pi, vec_cf, K, T, dt, report, greeks);
+    });
+}
+
+void price_european_options_on_bond_using_ho_lee(TermStructure* initial,
+    const double& delta,
+    const double& pi,
+    const std::vector<double>& underlying_bond_cflow_times,
+    const std::vector<double>& underlying_bond_cflows,
+    const std::vector<double>& strikes,
+    const double& option_time_to_maturity,
+    const std::vector<double>& market_times,
+    const std::vector<double>& market_prices,
+    std::vector<double>& call_prices,
+    std::vector<double>* put_prices,
+    const HoLeeCalibrationSettings& settings,
+    HoLeeCalibrationCache* cache,
+    HoLeePricingReport* report,
+    const double& dt) {
+
+    int T = ho_lee_expiry_step(option_time_to_maturity, dt);
+    call_prices.assign(strikes.size(), 0.0);
+    if (put_prices) put_prices->assign(strikes.size(), 0.0);
+    if (strikes.empty()) return;
 
+    TermStructureHoLee ho_lee_model = calibrate_ho_lee_for_expiry(initial, delta, pi, T, dt, market_times, market_prices,
+                                                                  settings, cache, report);
+    auto vec_cf = build_time_series_of_bond_time_contingent_cash_flows(underlying_bond_cflow_times, underlying_bond_cflows, dt);
+    if (T >= int(vec_cf.size())) return; // every cash flow is paid before expiry
 
-    for (size_t i = 0; i < hl_tree.size(); ++i) { // time i
-        const auto& row = hl_tree[i];
-        for (size_t j = 0; j < row.size(); ++j) { // statue j
-            const auto& node = row[j];
-            // std::cout << "Discount factor at row " << i << " node " << j << " is " << node.d(1.0) << std::endl;
+    std::vector<double> prices(put_prices ? 2 * strikes.size() : strikes.size());
+    with_concrete_curve(initial, [&](const auto* curve) {
+        price_european_options_on_ho_lee_lattice(curve, ho_lee_model.delta_, ho_lee_model.pi_, pi, vec_cf[T], strikes,
+                                                 put_prices != nullptr, T, dt, report, prices.data());
+    });
+    std::copy(prices.begin(), prices.begin() + strikes.size(), call_prices.begin());
+    if (put_prices) std::copy(prices.begin() + strikes.size(), prices.end(), put_prices->begin());
+}
+
+// Key rate pricing on any curve with getTimes() knots and a dAdjoint of d(t) into their yields
+template <class Curve>
+static double price_european_call_with_key_rates_on_curve(const Curve& initial,
+    const double& delta,
+    const double& pi,
+    const std::vector<double>& underlying_bond_cflow_times,
+    const std::vector<double>& underlying_bond_cflows,
+    const double& K,
+    const double& option_time_to_maturity,
+    const std::vector<double>& market_times,
+    std::vector<double>& key_rates,
+    const HoLeeCalibrationSettings& settings,
+    HoLeePricingReport* report,
+    const double& dt,
+    std::vector<double>* bond_key_rates) {
+
+    int T = ho_lee_expiry_step(option_time_to_maturity, dt);
+    key_rates.assign(initial.getTimes().size(), 0.0);
+    if (bond_key_rates) {
+        bond_key_rates->assign(initial.getTimes().size(), 0.0);
+        for (size_t c = 0; c < underlying_bond_cflow_times.size(); ++c) {
+            initial.dAdjoint(underlying_bond_cflow_times[c], underlying_bond_cflows[c], bond_key_rates->data());
         }
     }
 
-    // Print vec_cf and T for debugging
-    std::cout << "T: " << T << std::endl;
-    std::cout << "vec_cf:" << std::endl;
-    for (const auto& cf : vec_cf) {
-        cf.print();
-    }
+    std::vector<double> market_prices(market_times.size());
+    initial.d(market_times.data(), market_prices.data(), market_times.size());
+    HoLeePricingReport local_report;
+    if (!report) report = &local_report;
+    TermStructureHoLee ho_lee_model = calibrate_ho_lee_for_expiry(&initial, delta, pi, T, dt, market_times, market_prices,
+                                                                  settings, nullptr, report);
+    // The adjoint of the calibration holds only at an optimum
+    const bool calibrated = report->calibration.converged();
+    const double calibrated_delta = ho_lee_model.delta_;
+    auto vec_cf = build_time_series_of_bond_time_contingent_cash_flows(underlying_bond_cflow_times, underlying_bond_cflows, dt);
+    if (T >= int(vec_cf.size())) return 0.0; // every cash flow is paid before expiry
+    const TimeContingentCashFlows& expiry_cflows = vec_cf[T];
 
-    std::cout << "vec_cf.sizez():" << vec_cf.size() << std::endl;
-    std::cout << "underlying_bond_cflows.sizez():" << underlying_bond_cflows.size() << std::endl;
+    static thread_local HoLeeLattice<Curve> lattice;
+    static thread_local std::vector<double> values; // step t in values[t (t + 1) / 2 + i]
+    static thread_local std::vector<double> bond_prices;
+    static thread_local std::vector<double> state_prices;
 
-    std::vector<double> values(T + 1, 0.0);
-    for (int i = 0; i <= T; ++i) {
-        std::cout << "bonds price: " << bonds_price(vec_cf[T].times, vec_cf[T].cash_flows, hl_tree[T][i]) << std::endl;
-        values[i] = std::max(0.0, bonds_price(vec_cf[T].times, vec_cf[T].cash_flows, hl_tree[T][i]) - K); // Call payoffs at maturity
-        std::cout << "check i :" << i << std::endl;
-        std::cout << "values[i] :" << values[i] << std::endl;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    lattice.reset(&initial, T + 1, calibrated_delta, ho_lee_model.pi_, dt);
+    values.resize(size_t(T + 1) * (T + 2) / 2);
+    bond_prices.resize(T + 1);
+    lattice.bondPrices(T, expiry_cflows.times, expiry_cflows.cash_flows, bond_prices.data());
+    double* expiry = &values[size_t(T) * (T + 1) / 2];
+    for (int i = 0; i <= T; ++i) expiry[i] = std::max(0.0, bond_prices[i] - K);
+    if (report) {
+        report->lattice_steps = T + 1;
+        report->lattice_ms = elapsed_milliseconds(start);
     }
 
+    // Backward induction, keeping every step for the reverse sweep
+    start = std::chrono::steady_clock::now();
+    const double* delta_powers = lattice.deltaPowers();
     for (int t = T - 1; t >= 0; --t) {
-        std::vector<double> values_this(t + 1, 0.0);
+        const double step_factor = lattice.stepFactor(t);
+        const double* next = &values[size_t(t + 1) * (t + 2) / 2];
+        double* row = &values[size_t(t) * (t + 1) / 2];
         for (int i = 0; i <= t; ++i) {
-            values_this[i] = (pi * values[i + 1] + (1.0 - pi) * values[i]) * hl_tree[t][i].d(1);
+            row[i] = (pi * next[i + 1] + (1.0 - pi) * next[i]) * step_factor * delta_powers[t - i];
         }
-        values = values_this;
+    }
+    const double price = values[0];
+    if (!calibrated) {
+        key_rates.assign(key_rates.size(), std::numeric_limits<double>::quiet_NaN());
+        report->induction_ms = elapsed_milliseconds(start);
+        return price;
     }
 
-    return values[0];
+    // Reverse sweep, forward in time. The adjoint of the value at node (t, i) is its state price,
+    // and each step's values enter only through log a_t and delta^(t - i).
+    double delta_bar = 0.0, pi_bar = 0.0;
+    double* yields_bar = key_rates.data();
+    state_prices.assign(T + 1, 0.0);
+    state_prices[0] = 1.0;
+    for (int t = 0; t < T; ++t) {
+        const double step_factor = lattice.stepFactor(t);
+        const double* row = &values[size_t(t) * (t + 1) / 2];
+        double log_step_factor_bar = 0.0;
+        for (int i = 0; i <= t; ++i) {
+            double weighted = state_prices[i] * row[i];
+            log_step_factor_bar += weighted;
+            delta_bar += weighted * (t - i) / calibrated_delta;
+        }
+        // log a_t = log D((t + 1) dt) - log D(t dt) + log node factor in (delta, pi)
+        initial.dAdjoint((t + 1) * dt, log_step_factor_bar / initial.d((t + 1) * dt), yields_bar);
+        initial.dAdjoint(t * dt, -log_step_factor_bar / initial.d(t * dt), yields_bar);
+        delta_bar += log_step_factor_bar * lattice.stepFactorLogDerivativeDelta(t);
+        pi_bar += log_step_factor_bar * lattice.stepFactorLogDerivativePi(t);
+
+        // State prices of step t + 1, updated in place from the top node down
+        state_prices[t + 1] = pi * step_factor * delta_powers[0] * state_prices[t];
+        for (int i = t; i > 0; --i) {
+            state_prices[i] = (1.0 - pi) * step_factor * delta_powers[t - i] * state_prices[i]
+                            + pi * step_factor * delta_powers[t - i + 1] * state_prices[i - 1];
+        }
+        state_prices[0] = (1.0 - pi) * step_factor * delta_powers[t] * state_prices[0];
+    }
+
+    // Bond prices at expiry: B_i = sum_c c A_T(tau_c) delta^(tau_c (T - i)), in the money nodes only
+    const double log_delta = std::log(calibrated_delta);
+    for (size_t c = 0; c < expiry_cflows.times.size(); ++c) {
+        const double& tau = expiry_cflows.times[c];
+        double periods = hoLeePeriods(tau, dt);
+        double log_a_d_delta, log_a_d_pi;
+        double log_a = lattice.logStepFactor(T, tau, log_a_d_delta, log_a_d_pi);
+        double log_a_bar = 0.0;
+        for (int i = 0; i <= T; ++i) {
+            if (bond_prices[i] <= K) continue;
+            double weighted = state_prices[i] * expiry_cflows.cash_flows[c] * std::exp(log_a + periods * (T - i) * log_delta);
+            log_a_bar += weighted;
+            delta_bar += weighted * periods * (T - i) / calibrated_delta;
+        }
+        initial.dAdjoint(tau + T * dt, log_a_bar / initial.d(tau + T * dt), yields_bar);
+        initial.dAdjoint(T * dt, -log_a_bar / initial.d(T * dt), yields_bar);
+        delta_bar += log_a_bar * log_a_d_delta;
+        pi_bar += log_a_bar * log_a_d_pi;
+    }
+
+    // Calibration: forward k = D(tau_k + n dt) / D(n dt) and market price k = D(tau_k), n = T + 1
+    std::vector<double> log_forwards_bar, market_prices_bar;
+    ho_lee_model.calibrationAdjoint(market_times, market_prices, delta_bar, pi_bar, log_forwards_bar, market_prices_bar);
+    const double n_dt = (T + 1) * dt;
+    double log_d_n_bar = 0.0;
+    for (size_t k = 0; k < market_times.size(); ++k) {
+        initial.dAdjoint(market_times[k] + n_dt, log_forwards_bar[k] / initial.d(market_times[k] + n_dt), yields_bar);
+        log_d_n_bar -= log_forwards_bar[k];
+        initial.dAdjoint(market_times[k], market_prices_bar[k], yields_bar);
+    }
+    initial.dAdjoint(n_dt, log_d_n_bar / initial.d(n_dt), yields_bar);
+    report->induction_ms = elapsed_milliseconds(start);
+
+    return price;
+}
+
+double price_european_call_option_on_bond_with_key_rates(const TermStructureInterpolated& initial,
+    const double& delta,
+    const double& pi,
+    const std::vector<double>& underlying_bond_cflow_times,
+    const std::vector<double>& underlying_bond_cflows,
+    const double& K,
+    const double& option_time_to_maturity,
+    const std::vector<double>& market_times,
+    std::vector<double>& key_rates,
+    const HoLeeCalibrationSettings& settings,
+    HoLeePricingReport* report,
+    const double& dt,
+    std::vector<double>* bond_key_rates) {
+    return price_european_call_with_key_rates_on_curve(initial, delta, pi, underlying_bond_cflow_times, underlying_bond_cflows,
+                                                       K, option_time_to_maturity, market_times, key_rates, settings,
+                                                       report, dt, bond_key_rates);
+}
+
+double price_european_call_option_on_bond_with_key_rates(const TermStructureCubicSpline& initial,
+    const double& delta,
+    const double& pi,
+    const std::vector<double>& underlying_bond_cflow_times,
+    const std::vector<double>& underlying_bond_cflows,
+    const double& K,
+    const double& option_time_to_maturity,
+    const std::vector<double>& market_times,
+    std::vector<double>& key_rates,
+    const HoLeeCalibrationSettings& settings,
+    HoLeePricingReport* report,
+    const double& dt,
+    std::vector<double>* bond_key_rates) {
+    return price_european_call_with_key_rates_on_curve(initial, delta, pi, underlying_bond_cflow_times, underlying_bond_cflows,
+                                                       K, option_time_to_maturity, market_times, key_rates, settings,
+                                                       report, dt, bond_key_rates);
+}
+
+double price_callable_bond_using_ho_lee(TermStructure* initial,
+    const double& delta,
+    const double& pi,
+    const std::vector<double>& bond_cflow_times,
+    const std::vector<double>& bond_cflows,
+    const BondEmbeddedOptions& options,
+    const std::vector<double>& market_times,
+    const std::vector<double>& market_prices,
+    double* straight_bond_price,
+    const HoLeeCalibrationSettings& settings,
+    HoLeeCalibrationCache* cache,
+    HoLeePricingReport* report,
+    const double& dt) {
+
+    // Cash flows summed per step; flows before today are already paid
+    std::vector<int> cflow_steps = ho_lee_exercise_steps(bond_cflow_times, dt);
+    int N = 0;
+    for (const int& step : cflow_steps) N = std::max(N, step);
+    std::vector<double> step_cflows(N + 1, 0.0);
+    for (size_t k = 0; k < cflow_steps.size(); ++k) {
+        if (cflow_steps[k] >= 0) step_cflows[cflow_steps[k]] += bond_cflows[k];
+    }
+
+    // Calls and puts while the bond is outstanding; the lower call and higher put win on a shared step
+    const double unbounded = std::numeric_limits<double>::infinity();
+    std::vector<double> call_levels(N + 1, unbounded);
+    std::vector<double> put_levels(N + 1, -unbounded);
+    std::vector<int> call_steps = ho_lee_exercise_steps(options.call_times, dt);
+    std::vector<int> put_steps = ho_lee_exercise_steps(options.put_times, dt);
+    for (size_t k = 0; k < call_steps.size(); ++k) {
+        if (call_steps[k] >= 0 && call_steps[k] < N) {
+            call_levels[call_steps[k]] = std::min(call_levels[call_steps[k]], options.call_prices[k]);
+        }
+    }
+    for (size_t k = 0; k < put_steps.size(); ++k) {
+        if (put_steps[k] >= 0 && put_steps[k] < N) {
+            put_levels[put_steps[k]] = std::max(put_levels[put_steps[k]], options.put_prices[k]);
+        }
+    }
+
+    TermStructureHoLee ho_lee_model = calibrate_ho_lee_for_expiry(initial, delta, pi, N, dt, market_times, market_prices,
+                                                                  settings, cache, report);
+    return with_concrete_curve(initial, [&](const auto* curve) {
+        return price_callable_bond_on_ho_lee_lattice(curve, ho_lee_model.delta_, ho_lee_model.pi_, pi, step_cflows,
+                                                     call_levels, put_levels, N, dt, straight_bond_price, report);
+    });
+}
+
+double price_bermudan_option_on_bond_using_ho_lee(TermStructure* initial,
+    const double& delta,
+    const double& pi,
+    const std::vector<double>& underlying_bond_cflow_times,
+    const std::vector<double>& underlying_bond_cflows,
+    const BondOptionType& type,
+    const double& K,
+    const double& option_time_to_maturity,
+    const std::vector<int>& exercise_steps,
+    const std::vector<double>& market_times,
+    const std::vector<double>& market_prices,
+    std::vector<HoLeeExerciseBoundary>* boundaries,
+    const HoLeeCalibrationSettings& settings,
+    HoLeeCalibrationCache* cache,
+    HoLeePricingReport* report,
+    const double& dt) {
+
+    int T = ho_lee_expiry_step(option_time_to_maturity, dt);
+    std::vector<char> exercisable(T + 1, 0);
+    exercisable[T] = 1;
+    for (const int& step : exercise_steps) {
+        if (step >= 0 && step <= T) exercisable[step] = 1;
+    }
+
+    TermStructureHoLee ho_lee_model = calibrate_ho_lee_for_expiry(initial, delta, pi, T, dt, market_times, market_prices,
+                                                                  settings, cache, report);
+    auto vec_cf = build_time_series_of_bond_time_contingent_cash_flows(underlying_bond_cflow_times, underlying_bond_cflows, dt);
+
+    return with_concrete_curve(initial, [&](const auto* curve) {
+        return price_bermudan_option_on_ho_lee_lattice(curve, ho_lee_model.delta_, ho_lee_model.pi_, pi, vec_cf, type, K,
+                                                       exercisable, T, dt, boundaries, report);
+    });
+}
+
+double price_asian_option_on_bond_using_ho_lee_monte_carlo(TermStructure* initial,
+    const double& delta,
+    const double& pi,
+    const std::vector<double>& underlying_bond_cflow_times,
+    const std::vector<double>& underlying_bond_cflows,
+    const BondOptionType& type,
+    const double& K,
+    const double& option_time_to_maturity,
+    const std::vector<int>& averaging_steps,
+    const std::vector<double>& market_times,
+    const std::vector<double>& market_prices,
+    const HoLeeMonteCarloSettings& monte_carlo,
+    HoLeeMonteCarloResult* result,
+    const HoLeeCalibrationSettings& settings,
+    HoLeeCalibrationCache* cache,
+    HoLeePricingReport* report,
+    const double& dt) {
+
+    int T = ho_lee_expiry_step(option_time_to_maturity, dt);
+    std::vector<int> steps;
+    for (const int& step : averaging_steps) {
+        if (step >= 0 && step <= T) steps.push_back(step);
+    }
+    if (averaging_steps.empty()) {
+        for (int step = std::min(1, T); step <= T; ++step) steps.push_back(step);
+    }
+    std::sort(steps.begin(), steps.end());
+    steps.erase(std::unique(steps.begin(), steps.end()), steps.end());
+    if (steps.empty()) {
+        std::cerr << "No averaging step on or before expiry" << std::endl;
+        return 0.0;
+    }
+
+    TermStructureHoLee ho_lee_model = calibrate_ho_lee_for_expiry(initial, delta, pi, T, dt, market_times, market_prices,
+                                                                  settings, cache, report);
+    auto vec_cf = build_time_series_of_bond_time_contingent_cash_flows(underlying_bond_cflow_times, underlying_bond_cflows, dt);
+
+    return with_concrete_curve(initial, [&](const auto* curve) {
+        return price_average_price_option_on_ho_lee_paths(curve, ho_lee_model.delta_, ho_lee_model.pi_, pi, vec_cf, type, K,
+                                                          steps, T, dt, monte_carlo, result, report);
+    });
 }
 
 // Function to generate cash flow times and cash flows for a bond
@@ -4,8 +4,13 @@
 
 #include <vector>
 #include "TermStructure.h"
+#include "TermStructureHoLee.h"
+#include "HoLeeMonteCarlo.h"
 #include <iostream>
 
+class HoLeeCalibrationCache;
+class TermStructureCubicSpline;
+
 class TimeContingentCashFlows {
 public:
     std::vector<double> times;
@@ -29,8 +34,64 @@ public:
     }
 };
 
+enum class BondOptionType {
+    Call, // pays bond price - K
+    Put   // pays K - bond price
+};
+
+// Exercise region of one exercise step of a Bermudan option, from its boundary inward: calls are
+// exercised at node and above (higher bond prices), puts at node and below
+struct HoLeeExerciseBoundary {
+    int step;
+    double time; // step * dt
+    int node; // -1 when no node of the step is exercised
+    double bond_price; // bond price at node, the critical price of the step
+
+    HoLeeExerciseBoundary(const int& step, const double& time, const int& node, const double& bond_price);
+};
+
+// Call and put schedule of a bond, times in the unit of its cash flow times. At call_times[k] the
+// issuer may redeem the bond for call_prices[k] and at put_times[k] the holder may sell it back
+// for put_prices[k], in both cases on top of the cash flow due at that time.
+struct BondEmbeddedOptions {
+    std::vector<double> call_times;
+    std::vector<double> call_prices;
+    std::vector<double> put_times;
+    std::vector<double> put_prices;
+};
+
+// Sensitivities of a European option from the backward induction that prices it. delta, gamma and
+// theta come from the option and bond values at the nodes of steps 1 and 2: they are NaN when the
+// option expires before step 2, and delta and gamma are zero when the bond prices they divide by
+// coincide. The lattice's
+// discount factors come from the calibrated delta and pi while the induction branches with the pi
+// of the request, so the pi sensitivities are kept apart: ho_lee_delta and ho_lee_pi are the exact
+// derivatives of the price in the calibrated per-step delta and pi, through every discount factor,
+// and branching_pi the exact derivative in the branching probability.
+struct HoLeeGreeks {
+    double delta; // d price / d bond price
+    double gamma; // d delta / d bond price
+    double theta; // d price / d time, per unit of the maturity's time
+    double ho_lee_delta; // d price / d calibrated delta
+    double ho_lee_pi; // d price / d calibrated pi, discount factors only
+    double branching_pi; // d price / d pi of the induction
+
+    HoLeeGreeks();
+};
+
+// Work done by one price_european_call_option_on_bond_using_ho_lee call
+struct HoLeePricingReport {
+    HoLeeCalibrationReport calibration;
+    int lattice_steps; // node rows of the lattice the product was valued on, today included
+    double lattice_ms; // lattice and bond prices at expiry
+    double induction_ms;
+
+    HoLeePricingReport();
+};
+
 std::vector<TimeContingentCashFlows> build_time_series_of_bond_time_contingent_cash_flows(const std::vector<double>& initial_times,
-                                                                                          const std::vector<double>& initial_cflows);
+                                                                                          const std::vector<double>& initial_cflows,
+                                                                                          const double& dt = 1.0);
 
 double price_european_call_option_on_bond_using_ho_lee(TermStructure* initial, 
                                                         const double& delta, 
@@ -40,7 +101,134 @@ double price_european_call_option_on_bond_using_ho_lee(TermStructure* initial,
                                                         const double& K, 
                                                         const double& option_time_to_maturity,
                                                         const std::vector<double>& market_times,
-                                                        const std::vector<double>& market_prices);
+                                                        const std::vector<double>& market_prices,
+                                                        const HoLeeCalibrationSettings& settings = HoLeeCalibrationSettings(),
+                                                        HoLeeCalibrationCache* cache = nullptr, // reuses calibrations across calls when given
+                                                        HoLeePricingReport* report = nullptr,
+                                                        const double& dt = 1.0, // lattice step, in the unit of the maturity and cash flow times
+                                                        HoLeeGreeks* greeks = nullptr); // filled from the same induction when given
+
+// Lattice step of an option expiring at option_time_to_maturity, and the nearest steps of
+// exercise times given in the same unit
+int ho_lee_expiry_step(const double& option_time_to_maturity, const double& dt = 1.0);
+std::vector<int> ho_lee_exercise_steps(const std::vector<double>& exercise_times, const double& dt = 1.0);
+
+// European calls, and optionally puts, on the bond for every strike of a ladder in one lattice
+// pass: one calibration, one set of bond prices at expiry and one backward induction over all
+// strikes. call_prices[s] and (*put_prices)[s] are the prices for strikes[s].
+void price_european_options_on_bond_using_ho_lee(TermStructure* initial,
+                                                 const double& delta,
+                                                 const double& pi,
+                                                 const std::vector<double>& underlying_bond_cflow_times,
+                                                 const std::vector<double>& underlying_bond_cflows,
+                                                 const std::vector<double>& strikes,
+                                                 const double& option_time_to_maturity,
+                                                 const std::vector<double>& market_times,
+                                                 const std::vector<double>& market_prices,
+                                                 std::vector<double>& call_prices,
+                                                 std::vector<double>* put_prices = nullptr, // puts priced in the same pass when given
+                                                 const HoLeeCalibrationSettings& settings = HoLeeCalibrationSettings(),
+                                                 HoLeeCalibrationCache* cache = nullptr,
+                                                 HoLeePricingReport* report = nullptr,
+                                                 const double& dt = 1.0);
+
+// The European call of price_european_call_option_on_bond_using_ho_lee, calibrated to the curve's
+// own zero coupon prices at market_times, with its key rate sensitivities key_rates[j] = d price /
+// d yield of knot j of the curve. One reverse (adjoint) sweep carries the price back through the
+// backward induction, the lattice discount factors, the calibration (implicit function theorem at
+// the Levenberg-Marquardt optimum) and the curve's interpolation, so the whole gradient costs a
+// few pricings whatever the number of knots. bond_key_rates, when given, receives the same
+// sensitivities of the underlying bond's price today, sum_c c D(t_c) on the curve. When the
+// calibration does not converge the key rates are NaN; report->calibration tells why.
+double price_european_call_option_on_bond_with_key_rates(const TermStructureInterpolated& initial,
+                                                         const double& delta,
+                                                         const double& pi,
+                                                         const std::vector<double>& underlying_bond_cflow_times,
+                                                         const std::vector<double>& underlying_bond_cflows,
+                                                         const double& K,
+                                                         const double& option_time_to_maturity,
+                                                         const std::vector<double>& market_times,
+                                                         std::vector<double>& key_rates,
+                                                         const HoLeeCalibrationSettings& settings = HoLeeCalibrationSettings(),
+                                                         HoLeePricingReport* report = nullptr,
+                                                         const double& dt = 1.0,
+                                                         std::vector<double>* bond_key_rates = nullptr);
+double price_european_call_option_on_bond_with_key_rates(const TermStructureCubicSpline& initial,
+                                                         const double& delta,
+                                                         const double& pi,
+                                                         const std::vector<double>& underlying_bond_cflow_times,
+                                                         const std::vector<double>& underlying_bond_cflows,
+                                                         const double& K,
+                                                         const double& option_time_to_maturity,
+                                                         const std::vector<double>& market_times,
+                                                         std::vector<double>& key_rates,
+                                                         const HoLeeCalibrationSettings& settings = HoLeeCalibrationSettings(),
+                                                         HoLeePricingReport* report = nullptr,
+                                                         const double& dt = 1.0,
+                                                         std::vector<double>* bond_key_rates = nullptr);
+
+// Bond with embedded call and put options, valued by one backward induction over the lattice to
+// the bond's last cash flow. Cash flow, call and put times are rounded to the nearest lattice step.
+// straight_bond_price receives the value of the same cash flows without the options, from the
+// same pass.
+double price_callable_bond_using_ho_lee(TermStructure* initial,
+                                        const double& delta,
+                                        const double& pi,
+                                        const std::vector<double>& bond_cflow_times,
+                                        const std::vector<double>& bond_cflows,
+                                        const BondEmbeddedOptions& options,
+                                        const std::vector<double>& market_times,
+                                        const std::vector<double>& market_prices,
+                                        double* straight_bond_price = nullptr,
+                                        const HoLeeCalibrationSettings& settings = HoLeeCalibrationSettings(),
+                                        HoLeeCalibrationCache* cache = nullptr,
+                                        HoLeePricingReport* report = nullptr,
+                                        const double& dt = 1.0);
+
+// Bermudan option on the bond, exercisable at the given lattice steps and always at expiry; pass
+// every step from 0 to the expiry step for an American option. Steps after expiry are ignored.
+// The exercise decision is taken in the backward induction itself, against the bond price of each
+// node, and boundaries receives the exercise boundary of every exercise step in ascending order.
+double price_bermudan_option_on_bond_using_ho_lee(TermStructure* initial,
+                                                  const double& delta,
+                                                  const double& pi,
+                                                  const std::vector<double>& underlying_bond_cflow_times,
+                                                  const std::vector<double>& underlying_bond_cflows,
+                                                  const BondOptionType& type,
+                                                  const double& K,
+                                                  const double& option_time_to_maturity,
+                                                  const std::vector<int>& exercise_steps,
+                                                  const std::vector<double>& market_times,
+                                                  const std::vector<double>& market_prices,
+                                                  std::vector<HoLeeExerciseBoundary>* boundaries = nullptr,
+                                                  const HoLeeCalibrationSettings& settings = HoLeeCalibrationSettings(),
+                                                  HoLeeCalibrationCache* cache = nullptr,
+                                                  HoLeePricingReport* report = nullptr,
+                                                  const double& dt = 1.0);
+
+// Average price option on the bond: pays at expiry on the mean of the bond's prices at the given
+// lattice steps (every step from 1 to expiry when empty; steps after expiry are ignored). The
+// average depends on the route a path takes, so the option is valued by Monte Carlo over the
+// calibrated lattice's dynamics. The control variate is the European option of the same type and
+// strike on the bond at expiry, whose price is exact on the same lattice. result receives the
+// estimate's standard error, the paths simulated and the control.
+double price_asian_option_on_bond_using_ho_lee_monte_carlo(TermStructure* initial,
+                                                           const double& delta,
+                                                           const double& pi,
+                                                           const std::vector<double>& underlying_bond_cflow_times,
+                                                           const std::vector<double>& underlying_bond_cflows,
+                                                           const BondOptionType& type,
+                                                           const double& K,
+                                                           const double& option_time_to_maturity,
+                                                           const std::vector<int>& averaging_steps,
+                                                           const std::vector<double>& market_times,
+                                                           const std::vector<double>& market_prices,
+                                                           const HoLeeMonteCarloSettings& monte_carlo = HoLeeMonteCarloSettings(),
+                                                           HoLeeMonteCarloResult* result = nullptr,
+                                                           const HoLeeCalibrationSettings& settings = HoLeeCalibrationSettings(),
+                                                           HoLeeCalibrationCache* cache = nullptr,
+                                                           HoLeePricingReport* report = nullptr,
+                                                           const double& dt = 1.0);
 void generate_bond_cash_flows(double face_value, double coupon_rate, double time_to_maturity,
     std::vector<double>& underlying_bond_cflow_times,
     std::vector<double>& underlying_bond_cflows);
@@ -0,0 +1,142 @@
+// calibrate_history.cpp
+// Calibrates the Ho-Lee model to the curve of every observation date in cubic.csv and writes
+// the time series date,delta,pi,residual_norm,iterations,status to standard output in date order.
+// status is the Levenberg-Marquardt status of the solve, 1 to 4 when it converged; dates whose
+// solve did not converge are also reported on standard error.
+// Usage: calibrate_history.exe [steps] [threads] > history.csv
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+
+#include "CurveStore.h"
+#include "CurveStore.cpp"
+#include "TermStructure.h"
+#include "TermStructure.cpp"
+#include "TermStructureCubicSpline.h"
+#include "TermStructureCubicSpline.cpp"
+#include "TermStructureNelsonSiegel.h"
+#include "TermStructureNelsonSiegel.cpp"
+#include "TermStructureHoLee.h"
+#include "TermStructureHoLee.cpp"
+
+using namespace std;
+
+struct CalibrationResult {
+    bool done;
+    bool ok;
+    double delta;
+    double pi;
+    HoLeeCalibrationReport report;
+
+    CalibrationResult() : done(false), ok(false), delta(0.0), pi(0.0) {}
+};
+
+// Scratch buffers owned by one worker and reused for every date it calibrates, including those of
+// the Ho-Lee solve itself
+struct CalibrationWorkspace {
+    vector<double> knot_days;
+    vector<double> knot_rates;
+    vector<double> prices;
+    HoLeeCalibrationWorkspace solve;
+};
+
+// Same calibration set as the server: the spline's discount factors on days 1 to 5400
+bool calibrateDate(const CurveStore& curves, const size_t& k, const vector<double>& times, const int& steps,
+                   CalibrationWorkspace& workspace, CalibrationResult& result) {
+    size_t points = curves.points(k);
+    if (points == 0) return false;
+    workspace.knot_days.resize(points);
+    workspace.knot_rates.assign(curves.rates(k), curves.rates(k) + points);
+    for (size_t j = 0; j < points; ++j) {
+        workspace.knot_days[j] = cubicKnotDays(curves.days(k)[j]);
+    }
+    TermStructureCubicSpline curve(workspace.knot_days, workspace.knot_rates);
+
+    workspace.prices.resize(times.size());
+    curve.d(times.data(), workspace.prices.data(), times.size());
+
+    // Started from the front end's defaults on every date so each row is independent of the others
+    TermStructureHoLee model(&curve, steps, 0, 0.98, 0.5);
+    model.calibrate(times, workspace.prices, vector<double>(), HoLeeCalibrationSettings(), result.report, workspace.solve);
+    result.delta = model.delta_;
+    result.pi = model.pi_;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    int steps = argc > 1 ? atoi(argv[1]) : 6;
+    int threads = argc > 2 ? atoi(argv[2]) : int(thread::hardware_concurrency());
+    threads = max(1, threads);
+    if (steps < 1) {
+        cerr << "Usage: calibrate_history.exe [steps] [threads]" << endl;
+        return 1;
+    }
+
+    CurveStore curves;
+    if (!curves.open("cubic.curves", "cubic.csv")) {
+        cerr << "Unable to load the curves of cubic.csv" << endl;
+        return 1;
+    }
+
+    vector<double> times(5400);
+    for (size_t day = 0; day < times.size(); ++day) {
+        times[day] = day + 1.0;
+    }
+
+    // Workers take dates in order from a shared counter; the main thread writes each row as
+    // soon as every earlier date has finished
+    vector<CalibrationResult> results(curves.size());
+    mutex results_mutex;
+    condition_variable finished;
+    atomic<size_t> next(0);
+
+    vector<thread> workers;
+    for (int w = 0; w < threads; ++w) {
+        workers.push_back(thread([&]() {
+            CalibrationWorkspace workspace;
+            for (size_t k = next++; k < results.size(); k = next++) {
+                CalibrationResult result;
+                result.ok = calibrateDate(curves, k, times, steps, workspace, result);
+                result.done = true;
+                {
+                    lock_guard<mutex> lock(results_mutex);
+                    results[k] = result;
+                }
+                finished.notify_all();
+            }
+        }));
+    }
+
+    cout << "date,delta,pi,residual_norm,iterations,status" << endl;
+    char row[160];
+    for (size_t k = 0; k < results.size(); ++k) {
+        CalibrationResult result;
+        {
+            unique_lock<mutex> lock(results_mutex);
+            finished.wait(lock, [&]() { return results[k].done; });
+            result = results[k];
+        }
+        int date = curves.date(k);
+        if (!result.ok) {
+            cerr << "Skipping " << date << ": no curve points" << endl;
+            continue;
+        }
+        if (!result.report.converged()) {
+            cerr << "Calibration of " << date << " did not converge (status " << result.report.status << ")" << endl;
+        }
+        snprintf(row, sizeof(row), "%04d-%02d-%02d,%.12g,%.12g,%.12g,%d,%d",
+                 date / 10000, date / 100 % 100, date % 100,
+                 result.delta, result.pi, result.report.fnorm, result.report.iterations, result.report.status);
+        cout << row << endl;
+    }
+
+    for (thread& worker : workers) worker.join();
+    return 0;
+}
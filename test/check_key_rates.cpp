@@ -0,0 +1,125 @@
+// check_key_rates.cpp
+// Checks the adjoint key rates of price_european_call_option_on_bond_with_key_rates against
+// central differences of the option and bond prices, knot by knot, on both curves it accepts.
+// Every knot whose two gradients differ by more than the tolerance is reported on standard error,
+// and the exit status is the number of them.
+// Usage: check_key_rates.exe
+#include <iostream>
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "TermStructure.h"
+#include "TermStructure.cpp"
+#include "TermStructureCubicSpline.h"
+#include "TermStructureCubicSpline.cpp"
+#include "TermStructureNelsonSiegel.h"
+#include "TermStructureNelsonSiegel.cpp"
+#include "TermStructureHoLee.h"
+#include "TermStructureHoLee.cpp"
+#include "HoLeeCalibrationCache.h"
+#include "HoLeeCalibrationCache.cpp"
+#include "HoLeeMonteCarlo.h"
+#include "HoLeeMonteCarlo.cpp"
+#include "TimeContingentCashFlows.h"
+#include "TimeContingentCashFlows.cpp"
+
+using namespace std;
+
+// Option on a 6 year 5% bond, expiring in 1 year, on a quarterly lattice calibrated to the
+// curve's own quarterly zero coupon prices out to 8 years. The curve is one whose calibration has
+// an isolated optimum; on flatter curves the fit can drift off to pi far outside [0, 1].
+struct KeyRateCase {
+    vector<double> knot_times;
+    vector<double> knot_yields;
+    vector<double> bond_times;
+    vector<double> bond_cflows;
+    vector<double> market_times;
+    double K;
+    double expiry;
+    double dt;
+    HoLeeCalibrationSettings settings;
+
+    KeyRateCase() : K(100.0), expiry(1.0), dt(0.25) {
+        knot_times = {0.5, 1.0, 2.0, 3.0, 5.0, 7.0, 10.0};
+        knot_yields = {0.020, 0.025, 0.033, 0.040, 0.048, 0.052, 0.055};
+        for (int k = 1; k <= 12; ++k) {
+            bond_times.push_back(0.5 * k);
+            bond_cflows.push_back(k == 12 ? 102.5 : 2.5);
+        }
+        for (int k = 1; k <= 32; ++k) market_times.push_back(0.25 * k);
+        // The differences move with wherever the solve stops, so it has to stop much closer to
+        // the optimum than the default tolerances need
+        settings.ftol = 1e-14;
+        settings.xtol = 1e-14;
+        settings.maxfev = 10000;
+    }
+};
+
+template <class Curve>
+static double price(const KeyRateCase& c, const vector<double>& yields, vector<double>& key_rates,
+                    vector<double>& bond_key_rates, HoLeePricingReport& report) {
+    Curve curve(c.knot_times, yields);
+    return price_european_call_option_on_bond_with_key_rates(curve, 0.98, 0.5, c.bond_times, c.bond_cflows, c.K, c.expiry,
+                                                             c.market_times, key_rates, c.settings,
+                                                             &report, c.dt, &bond_key_rates);
+}
+
+static double bondPrice(const TermStructure& curve, const KeyRateCase& c) {
+    double value = 0.0;
+    for (size_t k = 0; k < c.bond_times.size(); ++k) value += c.bond_cflows[k] * curve.d(c.bond_times[k]);
+    return value;
+}
+
+// Errors are measured against the largest key rate: the differences carry the solver's noise at
+// a level set by the whole gradient, which swamps the relative error of its smallest entries
+static double scale(const vector<double>& key_rates) {
+    double largest = 1.0;
+    for (const double& key_rate : key_rates) largest = max(largest, fabs(key_rate));
+    return largest;
+}
+
+// Returns the number of mismatched knots
+template <class Curve>
+static int check(const char* name, const KeyRateCase& c) {
+    const double h = 1e-4;
+    const double tolerance = 1e-4;
+
+    vector<double> key_rates, bond_key_rates, unused, unused_bond;
+    HoLeePricingReport report;
+    double value = price<Curve>(c, c.knot_yields, key_rates, bond_key_rates, report);
+    if (!report.calibration.converged()) {
+        cerr << name << ": calibration did not converge (status " << report.calibration.status << ")" << endl;
+        return 1;
+    }
+    printf("%s: price %.10g, %d iterations\n", name, value, report.calibration.iterations);
+    printf("%8s %16s %16s %16s %16s\n", "knot", "option adjoint", "option fd", "bond adjoint", "bond fd");
+
+    const double option_scale = scale(key_rates), bond_scale = scale(bond_key_rates);
+    int mismatches = 0;
+    for (size_t j = 0; j < c.knot_times.size(); ++j) {
+        vector<double> up = c.knot_yields, down = c.knot_yields;
+        up[j] += h;
+        down[j] -= h;
+        HoLeePricingReport up_report, down_report;
+        double option_difference = (price<Curve>(c, up, unused, unused_bond, up_report)
+                                  - price<Curve>(c, down, unused, unused_bond, down_report)) / (2.0 * h);
+        double bond_difference = (bondPrice(Curve(c.knot_times, up), c) - bondPrice(Curve(c.knot_times, down), c)) / (2.0 * h);
+        printf("%8g %16.8g %16.8g %16.8g %16.8g\n", c.knot_times[j], key_rates[j], option_difference,
+               bond_key_rates[j], bond_difference);
+        if (fabs(key_rates[j] - option_difference) > tolerance * option_scale
+            || fabs(bond_key_rates[j] - bond_difference) > tolerance * bond_scale) {
+            cerr << name << ": key rate of knot " << c.knot_times[j] << " does not match its finite difference" << endl;
+            ++mismatches;
+        }
+    }
+    return mismatches;
+}
+
+int main() {
+    KeyRateCase c;
+    int mismatches = check<TermStructureInterpolated>("interpolated", c);
+    mismatches += check<TermStructureCubicSpline>("cubic spline", c);
+    return mismatches;
+}
@@ -3,13 +3,27 @@
 #include <sstream>
 #include <vector>
 #include <string>
+#include <thread>
+#include <algorithm>
+#include <memory>
+#include <cmath>
 
 #include "date.h"
 #include "date.cpp"
+#include "CurveStore.h"
+#include "CurveStore.cpp"
 #include "TermStructure.h"
 #include "TermStructure.cpp"
+#include "TermStructureCubicSpline.h"
+#include "TermStructureCubicSpline.cpp"
+#include "TermStructureNelsonSiegel.h"
+#include "TermStructureNelsonSiegel.cpp"
 #include "TermStructureHoLee.h"
 #include "TermStructureHoLee.cpp"
+#include "HoLeeCalibrationCache.h"
+#include "HoLeeCalibrationCache.cpp"
+#include "HoLeeMonteCarlo.h"
+#include "HoLeeMonteCarlo.cpp"
 #include "TimeContingentCashFlows.h"
 #include "TimeContingentCashFlows.cpp"
 
@@ -24,41 +38,171 @@ using namespace std;
 using namespace httplib;
 using json = nlohmann::json;
 
-// Define a structure for storing CSV data
-struct CSVRow {
-    vector<string> columns;
-};
+// Function to read the spline knots of the latest observation on or before curve_date
+bool loadCurveKnots(const CurveStore& curves, const string& curve_date, vector<double>& days, vector<double>& rates) {
+    size_t k;
+    if (!curves.isOpen() || !curves.find(CurveStore::parseDate(curve_date), k)) {
+        cerr << "No curve available for " << curve_date << endl;
+        return false;
+    }
 
-// Function to parse a CSV row
-CSVRow parseCSVRow(const string &line) {
-    CSVRow row;
-    stringstream ss(line);
-    string column;
-    while (getline(ss, column, ',')) {
-        row.columns.push_back(column);
+    days.resize(curves.points(k));
+    rates.assign(curves.rates(k), curves.rates(k) + curves.points(k));
+    for (size_t j = 0; j < days.size(); ++j) {
+        days[j] = cubicKnotDays(curves.days(k)[j]);
     }
-    return row;
+    return true;
 }
 
-// Function to read CSV and extract data
-void readCSV(const string& filename, vector<double>& times, vector<double>& yields) {
-    ifstream file(filename);
-    if (!file.is_open()) {
-        cerr << "Unable to open file" << endl;
-        return;
+// Inputs shared by the pricing endpoints: the bond, the option's expiry, the lattice and the
+// calibration set, read from the JSON payload of a request
+struct PricingRequest {
+    double delta;
+    double pi;
+    double time_to_expiry; // years
+    double time_step; // lattice step in years
+    DayCountConvention day_count;
+    bool diagnostics;
+    vector<double> bond_cflow_times;
+    vector<double> bond_cflows;
+    unique_ptr<TermStructureCubicSpline> initial;
+    vector<double> market_times; // calibration maturities in days
+    vector<double> market_prices;
+};
+
+// maturity_date, the option's expiry, may be left out by products without one. The bond is
+// coupon_rate and face_value over 10 years unless cash_flow_times (years) and cash_flows are given.
+bool parsePricingRequest(const json& params, const CurveStore& curves, PricingRequest& request, string& error) {
+    string maturity_date = params.value("maturity_date", string());
+
+    request.delta = params["delta"];
+    request.pi = params["pi"];
+    request.bond_cflow_times = params.value("cash_flow_times", vector<double>());
+    request.bond_cflows = params.value("cash_flows", vector<double>());
+    bool bond_schedule = !request.bond_cflow_times.empty();
+    double coupon_rate = bond_schedule ? 0.0 : params["coupon_rate"].get<double>();
+    double face_value = bond_schedule ? 0.0 : params["face_value"].get<double>();
+    int dcc_case = stoi(params["day_count_convention"]["value"].get<string>());
+    string curve_date = params.value("curve_date", string("2010-01-04"));
+    // Optional calibration set: maturities in days, or a number of log-spaced maturities
+    vector<double> calibration_tenors = params.value("calibration_tenors", vector<double>());
+    int calibration_points = params.value("calibration_points", 0);
+    request.diagnostics = params.value("diagnostics", false);
+    // Lattice step in years, e.g. 1.0 / 12 for monthly steps
+    request.time_step = params.value("time_step", 1.0);
+
+    // split maturity date
+    int eYear = 0, eMonth = 0, eDay = 0;
+    sscanf(maturity_date.c_str(), "%d-%d-%d", &eYear, &eMonth, &eDay);
+
+    // check values
+    cout << "maturity_date: " << maturity_date << endl;
+    cout << "eYear: " << eYear << endl;
+    cout << "eMonth: " << eMonth << endl;
+    cout << "eDay: " << eDay << endl;
+    cout << "delta: " << request.delta << endl;
+    cout << "pi: " << request.pi << endl;
+    cout << "coupon_rate: " << coupon_rate << endl;
+    cout << "face_value: " << face_value << endl;
+    cout << "day_count_convention: " << dcc_case << endl;
+    cout << "curve_date: " << curve_date << endl;
+    cout << "time_step: " << request.time_step << endl;
+
+    if (!(request.time_step > 0.0)) {
+        error = "time_step must be positive";
+        return false;
+    }
+    if (request.bond_cflow_times.size() != request.bond_cflows.size()) {
+        error = "cash_flow_times and cash_flows must have the same length";
+        return false;
     }
 
-    string line;
-    // Skip the header
-    getline(file, line);
-    while (getline(file, line)) {
-        CSVRow row = parseCSVRow(line);
-        if (row.columns.size() >= 2) {
-            times.push_back(stod(row.columns[0]));
-            yields.push_back(stod(row.columns[1]));
-        }
+    vector<double> knot_days;
+    vector<double> knot_rates;
+    
+    // upload_file
+    // Fit the cubic spline term structure to the curve observed on curve_date
+    if (!loadCurveKnots(curves, curve_date, knot_days, knot_rates)) {
+        error = "No curve available for " + curve_date;
+        return false;
     }
-    file.close();
+    
+    date startingDate = date::current_date();
+    date expirationDate = maturity_date.empty() ? startingDate : date(eDay, eMonth, eYear);
+
+    if (!startingDate.valid() || !expirationDate.valid()) {
+        error = "Invalid maturity_date " + maturity_date;
+        return false;
+    }
+
+    // Determine the day count convention based on combox selection
+    DayCountConvention dcc;
+
+    switch (dcc_case) {//should be imputed by dropdown list
+        case 0: dcc = DayCountConvention::Thirty360; break;
+        case 1: dcc = DayCountConvention::Thirty365; break;
+        case 2: dcc = DayCountConvention::Actual360; break;
+        case 3: dcc = DayCountConvention::Actual365; break;
+        case 4: dcc = DayCountConvention::ActualActual; break;
+        default:
+            error = "Invalid day count convention selected";
+            return false;
+    }
+    
+    request.day_count = dcc;
+
+    // Calculate the time to maturity using years_until method
+    request.time_to_expiry = startingDate.years_until(expirationDate, dcc);
+
+    cout << "timeToMaturity: " << request.time_to_expiry << endl;
+    //callable_bond_information
+    //Enter face value of the bond, Enter coupon rate of the bond (as a decimal), Enter time to maturity of the bond (in years)
+    //double face_value = 100, coupon_rate = 0.05, 
+    
+    double time_to_maturity = 10;
+    if (!bond_schedule) {
+        generate_bond_cash_flows(face_value, coupon_rate, time_to_maturity, request.bond_cflow_times, request.bond_cflows);
+    }
+
+    request.initial.reset(new TermStructureCubicSpline(knot_days, knot_rates));
+
+    // Calibrate to every day from 1 to 5400, the grid cubic.py used to write out, or the
+    // requested subset of it
+    vector<double>& getTime = request.market_times;
+    getTime.resize(5400);
+    for (size_t day = 0; day < getTime.size(); ++day) {
+        getTime[day] = day + 1.0;
+    }
+    if (!calibration_tenors.empty()) {
+        getTime = gatherInstruments(getTime, selectInstrumentsByTenor(getTime, calibration_tenors));
+    } else if (calibration_points > 0) {
+        getTime = gatherInstruments(getTime, selectInstrumentsLogSpaced(getTime, calibration_points));
+    }
+    request.market_prices.resize(getTime.size());
+    request.initial->d(getTime.data(), request.market_prices.data(), getTime.size());
+    return true;
+}
+
+// Calibration and lattice work behind a response, sent back when the request asks for diagnostics
+json diagnosticsJson(const PricingRequest& request, const HoLeePricingReport& pricing_report) {
+    const HoLeeCalibrationReport& calibration = pricing_report.calibration;
+    return {
+        {"calibration_status", calibration.status},
+        {"converged", calibration.converged()},
+        {"cached", calibration.cached},
+        {"iterations", calibration.iterations},
+        {"function_evaluations", calibration.nfev},
+        {"jacobian_evaluations", calibration.njev},
+        {"residual_norm", calibration.fnorm},
+        {"instruments", request.market_times.size()},
+        {"lattice_steps", pricing_report.lattice_steps},
+        {"timings_ms", {
+            {"calibration_setup", calibration.setup_ms},
+            {"calibration_solve", calibration.solve_ms},
+            {"lattice", pricing_report.lattice_ms},
+            {"induction", pricing_report.induction_ms}
+        }}
+    };
 }
 
 // CORS headers
@@ -70,6 +214,24 @@ void setup_cors_headers(Response &res) {
 
 int main() {
 
+    // Historical curves of cubic.csv, converted into a memory-mapped archive when it changes
+    CurveStore curves;
+    if (!curves.open("cubic.curves", "cubic.csv")) {
+        cerr << "Unable to load the curves of cubic.csv" << endl;
+        return 1;
+    }
+
+    // Calibrated Ho-Lee parameters of the most recently requested curves
+    HoLeeCalibrationCache calibrations;
+    HoLeeCalibrationSettings calibration_settings;
+    calibration_settings.threads = max(1u, thread::hardware_concurrency());
+    // One pool for the whole server rather than threads started and joined on every request
+    unique_ptr<Eigen::ThreadPool> worker_pool;
+    if (calibration_settings.threads > 1) {
+        worker_pool.reset(new Eigen::ThreadPool(calibration_settings.threads));
+        calibration_settings.pool = worker_pool.get();
+    }
+
     Server svr;
 
     svr.Options("/.*", [](const Request &req, Response &res) {
@@ -96,110 +258,359 @@ int main() {
     //     }
     // });
 
-    svr.Post("/calculate", [](const Request& req, Response& res) {
+    svr.Post("/calculate", [&curves, &calibrations, &calibration_settings](const Request& req, Response& res) {
         setup_cors_headers(res);
 
         auto params = json::parse(req.body);
 
         // get json data fron front-end
         double K = params["k"];
-        string maturity_date = params["maturity_date"];
-
-        double delta = params["delta"];
-        double pi = params["pi"];
-        double coupon_rate = params["coupon_rate"];
-        double face_value = params["face_value"];
-        int dcc_case = stoi(params["day_count_convention"]["value"].get<string>());
-
-        // split maturity date
-        int eYear, eMonth, eDay;
-        sscanf(maturity_date.c_str(), "%d-%d-%d", &eYear, &eMonth, &eDay);
-
-        // check values
         cout << "K: " << K << endl;
-        cout << "maturity_date: " << maturity_date << endl;
-        cout << "eYear: " << eYear << endl;
-        cout << "eMonth: " << eMonth << endl;
-        cout << "eDay: " << eDay << endl;
-        cout << "delta: " << delta << endl;
-        cout << "pi: " << pi << endl;
-        cout << "coupon_rate: " << coupon_rate << endl;
-        cout << "face_value: " << face_value << endl;
-        cout << "day_count_convention: " << dcc_case << endl;
-
-        vector<double> times_;
-        vector<double> yields_;
-        
-        // upload_file
-        // Read data from CSV
-        readCSV("maturity_days_and_rates.csv", times_, yields_);
-
-        // cubic term structure
-        // TermStructure* initial = new TermStructureInterpolated();
-
-        TermStructureInterpolated *initial = new TermStructureInterpolated(times_, yields_);
-        
-        date startingDate = date::current_date();
-        date expirationDate(eDay, eMonth, eYear);
-
-        if (!startingDate.valid() || !expirationDate.valid()) {
-            //error message
-            return 1;
-        }
-
-        // Determine the day count convention based on combox selection
-        DayCountConvention dcc;
-
-        switch (dcc_case) {//should be imputed by dropdown list
-            case 0: dcc = DayCountConvention::Thirty360; break;
-            case 1: dcc = DayCountConvention::Thirty365; break;
-            case 2: dcc = DayCountConvention::Actual360; break;
-            case 3: dcc = DayCountConvention::Actual365; break;
-            case 4: dcc = DayCountConvention::ActualActual; break;
-            default:
-                //error message "Invalid day count convention selected");
-                return 1;
-        }
-        
-        // Calculate the time to maturity using years_until method
-        double timeToMaturity = startingDate.years_until(expirationDate, dcc);
-
-        cout << "timeToMaturity: " << timeToMaturity << endl;
-        //callable_bond_information
-        //Enter face value of the bond, Enter coupon rate of the bond (as a decimal), Enter time to maturity of the bond (in years)
-        //double face_value = 100, coupon_rate = 0.05, 
-        
-        double time_to_maturity = 10;
-        vector<double> underlying_bond_cflow_times;
-        vector<double> underlying_bond_cflows;
-        generate_bond_cash_flows(face_value, coupon_rate, time_to_maturity, underlying_bond_cflow_times, underlying_bond_cflows);
-
-        vector<double> times;
-        times.push_back(5.0);
-        vector<double> cflows;
-        cflows.push_back(100);
 
-        json response;
+        // Optional Greeks from the same backward induction
+        bool with_greeks = params.value("greeks", false);
+        // Optional key rate sensitivities in the yields of the curve's knots, by adjoint
+        bool with_key_rates = params.value("key_rates", false);
+
+        PricingRequest request;
+        string error;
+        if (!parsePricingRequest(params, curves, request, error)) {
+            res.status = 400;
+            res.set_content(error, "text/plain");
+            return;
+        }
 
-        vector<double> getTime = initial->getTimes();
-        vector<double> getDiscountFactor = initial->getDiscountFactors();
+        json response;
 
-        double callable_bond_price = price_european_call_option_on_bond_using_ho_lee(initial,
-                                                                                    delta, 
-                                                                                    pi, 
-                                                                                    underlying_bond_cflow_times,
-                                                                                    underlying_bond_cflows, 
+        HoLeePricingReport pricing_report;
+        HoLeeGreeks greeks;
+        double callable_bond_price = price_european_call_option_on_bond_using_ho_lee(request.initial.get(),
+                                                                                    request.delta, 
+                                                                                    request.pi, 
+                                                                                    request.bond_cflow_times,
+                                                                                    request.bond_cflows, 
                                                                                     K, 
-                                                                                    timeToMaturity,
-                                                                                    getTime,
-                                                                                    getDiscountFactor);
+                                                                                    request.time_to_expiry,
+                                                                                    request.market_times,
+                                                                                    request.market_prices,
+                                                                                    calibration_settings,
+                                                                                    &calibrations,
+                                                                                    &pricing_report,
+                                                                                    request.time_step,
+                                                                                    with_greeks ? &greeks : nullptr);
 
         // test
         cout << "callable bond price: " << callable_bond_price << endl;
 
         response["callable_bond_price"] = callable_bond_price;
-        
-        delete initial;
+        if (with_greeks) {
+            response["greeks"] = {
+                {"ho_lee_delta", greeks.ho_lee_delta},
+                {"ho_lee_pi", greeks.ho_lee_pi},
+                {"branching_pi", greeks.branching_pi}
+            };
+            // Left out when the lattice has no steps 1 and 2 before expiry to take them from
+            if (!std::isnan(greeks.delta)) response["greeks"]["delta"] = greeks.delta;
+            if (!std::isnan(greeks.gamma)) response["greeks"]["gamma"] = greeks.gamma;
+            if (!std::isnan(greeks.theta)) response["greeks"]["theta"] = greeks.theta;
+        }
+        if (with_key_rates) {
+            // Calibrated without the cache: the adjoint needs the solve's own optimum. The
+            // sensitivities are null when that calibration does not converge.
+            vector<double> key_rates, bond_key_rates;
+            price_european_call_option_on_bond_with_key_rates(*request.initial,
+                                                              request.delta,
+                                                              request.pi,
+                                                              request.bond_cflow_times,
+                                                              request.bond_cflows,
+                                                              K,
+                                                              request.time_to_expiry,
+                                                              request.market_times,
+                                                              key_rates,
+                                                              calibration_settings,
+                                                              nullptr,
+                                                              request.time_step,
+                                                              &bond_key_rates);
+            json option_rates = json::array(), bond_rates = json::array();
+            for (size_t j = 0; j < key_rates.size(); ++j) {
+                if (std::isnan(key_rates[j])) option_rates.push_back(nullptr);
+                else option_rates.push_back(key_rates[j]);
+                bond_rates.push_back(bond_key_rates[j]);
+            }
+            response["key_rates"] = {
+                {"knot_days", request.initial->getTimes()},
+                {"option", option_rates},
+                {"bond", bond_rates}
+            };
+        }
+        if (request.diagnostics) response["diagnostics"] = diagnosticsJson(request, pricing_report);
+
+        res.set_content(response.dump(), "application/json");
+    });
+
+    // Strike ladder: "strikes" replaces "k", and "puts": true adds the puts of the same strikes
+    svr.Post("/calculate_strikes", [&curves, &calibrations, &calibration_settings](const Request& req, Response& res) {
+        setup_cors_headers(res);
+
+        auto params = json::parse(req.body);
+        vector<double> strikes = params.value("strikes", vector<double>());
+        bool puts = params.value("puts", false);
+        if (strikes.empty()) {
+            res.status = 400;
+            res.set_content("strikes must be a non-empty array", "text/plain");
+            return;
+        }
+
+        PricingRequest request;
+        string error;
+        if (!parsePricingRequest(params, curves, request, error)) {
+            res.status = 400;
+            res.set_content(error, "text/plain");
+            return;
+        }
+
+        HoLeePricingReport pricing_report;
+        vector<double> call_prices, put_prices;
+        price_european_options_on_bond_using_ho_lee(request.initial.get(),
+                                                    request.delta,
+                                                    request.pi,
+                                                    request.bond_cflow_times,
+                                                    request.bond_cflows,
+                                                    strikes,
+                                                    request.time_to_expiry,
+                                                    request.market_times,
+                                                    request.market_prices,
+                                                    call_prices,
+                                                    puts ? &put_prices : nullptr,
+                                                    calibration_settings,
+                                                    &calibrations,
+                                                    &pricing_report,
+                                                    request.time_step);
+
+        json response;
+        response["strikes"] = strikes;
+        response["call_prices"] = call_prices;
+        if (puts) response["put_prices"] = put_prices;
+        if (request.diagnostics) response["diagnostics"] = diagnosticsJson(request, pricing_report);
+
+        res.set_content(response.dump(), "application/json");
+    });
+
+    // Early exercise: "option_type" is "call" (default) or "put", and the exercise schedule is
+    // "exercise_steps" (lattice steps), "exercise_dates" (YYYY-MM-DD) or "american": true
+    svr.Post("/calculate_bermudan", [&curves, &calibrations, &calibration_settings](const Request& req, Response& res) {
+        setup_cors_headers(res);
+
+        auto params = json::parse(req.body);
+        double K = params["k"];
+        string option_type = params.value("option_type", string("call"));
+        bool american = params.value("american", false);
+        vector<int> exercise_steps = params.value("exercise_steps", vector<int>());
+        vector<string> exercise_dates = params.value("exercise_dates", vector<string>());
+        if (option_type != "call" && option_type != "put") {
+            res.status = 400;
+            res.set_content("option_type must be call or put", "text/plain");
+            return;
+        }
+
+        PricingRequest request;
+        string error;
+        if (!parsePricingRequest(params, curves, request, error)) {
+            res.status = 400;
+            res.set_content(error, "text/plain");
+            return;
+        }
+
+        if (american) {
+            exercise_steps.clear();
+            for (int step = 0; step <= ho_lee_expiry_step(request.time_to_expiry, request.time_step); ++step) {
+                exercise_steps.push_back(step);
+            }
+        } else if (!exercise_dates.empty()) {
+            date startingDate = date::current_date();
+            vector<double> exercise_times;
+            for (const string& exercise_date : exercise_dates) {
+                int year, month, day;
+                sscanf(exercise_date.c_str(), "%d-%d-%d", &year, &month, &day);
+                date exerciseDate(day, month, year);
+                if (!exerciseDate.valid()) {
+                    res.status = 400;
+                    res.set_content("Invalid exercise date " + exercise_date, "text/plain");
+                    return;
+                }
+                exercise_times.push_back(startingDate.years_until(exerciseDate, request.day_count));
+            }
+            exercise_steps = ho_lee_exercise_steps(exercise_times, request.time_step);
+        }
+
+        HoLeePricingReport pricing_report;
+        vector<HoLeeExerciseBoundary> boundaries;
+        double price = price_bermudan_option_on_bond_using_ho_lee(request.initial.get(),
+                                                                  request.delta,
+                                                                  request.pi,
+                                                                  request.bond_cflow_times,
+                                                                  request.bond_cflows,
+                                                                  option_type == "put" ? BondOptionType::Put : BondOptionType::Call,
+                                                                  K,
+                                                                  request.time_to_expiry,
+                                                                  exercise_steps,
+                                                                  request.market_times,
+                                                                  request.market_prices,
+                                                                  &boundaries,
+                                                                  calibration_settings,
+                                                                  &calibrations,
+                                                                  &pricing_report,
+                                                                  request.time_step);
+
+        json response;
+        response["price"] = price;
+        response["exercise_boundary"] = json::array();
+        for (const HoLeeExerciseBoundary& boundary : boundaries) {
+            response["exercise_boundary"].push_back({
+                {"step", boundary.step},
+                {"time", boundary.time},
+                {"node", boundary.node},
+                {"bond_price", boundary.bond_price}
+            });
+        }
+        if (request.diagnostics) response["diagnostics"] = diagnosticsJson(request, pricing_report);
+
+        res.set_content(response.dump(), "application/json");
+    });
+
+    // Callable and puttable bonds: "call_schedule" and "put_schedule" are arrays of
+    // {"time": years, "price": redemption price}; maturity_date is not needed
+    svr.Post("/calculate_callable", [&curves, &calibrations, &calibration_settings](const Request& req, Response& res) {
+        setup_cors_headers(res);
+
+        auto params = json::parse(req.body);
+        BondEmbeddedOptions options;
+        for (const json& call : params.value("call_schedule", json::array())) {
+            options.call_times.push_back(call["time"]);
+            options.call_prices.push_back(call["price"]);
+        }
+        for (const json& put : params.value("put_schedule", json::array())) {
+            options.put_times.push_back(put["time"]);
+            options.put_prices.push_back(put["price"]);
+        }
+
+        PricingRequest request;
+        string error;
+        if (!parsePricingRequest(params, curves, request, error)) {
+            res.status = 400;
+            res.set_content(error, "text/plain");
+            return;
+        }
+
+        HoLeePricingReport pricing_report;
+        double straight_bond_price = 0.0;
+        double bond_price = price_callable_bond_using_ho_lee(request.initial.get(),
+                                                             request.delta,
+                                                             request.pi,
+                                                             request.bond_cflow_times,
+                                                             request.bond_cflows,
+                                                             options,
+                                                             request.market_times,
+                                                             request.market_prices,
+                                                             &straight_bond_price,
+                                                             calibration_settings,
+                                                             &calibrations,
+                                                             &pricing_report,
+                                                             request.time_step);
+
+        json response;
+        response["callable_bond_price"] = bond_price;
+        response["straight_bond_price"] = straight_bond_price;
+        response["embedded_options_value"] = straight_bond_price - bond_price; // call minus put
+        if (request.diagnostics) response["diagnostics"] = diagnosticsJson(request, pricing_report);
+
+        res.set_content(response.dump(), "application/json");
+    });
+
+    // Average price (Asian) options by Monte Carlo over the calibrated lattice: "averaging_steps" or
+    // "averaging_dates" pick the averaging steps, every step to expiry by default
+    svr.Post("/calculate_asian", [&curves, &calibrations, &calibration_settings](const Request& req, Response& res) {
+        setup_cors_headers(res);
+
+        auto params = json::parse(req.body);
+        double K = params["k"];
+        string option_type = params.value("option_type", string("call"));
+        vector<int> averaging_steps = params.value("averaging_steps", vector<int>());
+        vector<string> averaging_dates = params.value("averaging_dates", vector<string>());
+        HoLeeMonteCarloSettings monte_carlo;
+        monte_carlo.paths = params.value("paths", monte_carlo.paths);
+        monte_carlo.seed = params.value("seed", monte_carlo.seed);
+        monte_carlo.antithetic = params.value("antithetic", monte_carlo.antithetic);
+        monte_carlo.control_variate = params.value("control_variate", monte_carlo.control_variate);
+        monte_carlo.threads = calibration_settings.threads;
+        monte_carlo.pool = calibration_settings.pool;
+        if (option_type != "call" && option_type != "put") {
+            res.status = 400;
+            res.set_content("option_type must be call or put", "text/plain");
+            return;
+        }
+        if (monte_carlo.paths < 1) {
+            res.status = 400;
+            res.set_content("paths must be positive", "text/plain");
+            return;
+        }
+
+        PricingRequest request;
+        string error;
+        if (!parsePricingRequest(params, curves, request, error)) {
+            res.status = 400;
+            res.set_content(error, "text/plain");
+            return;
+        }
+
+        if (averaging_steps.empty() && !averaging_dates.empty()) {
+            date startingDate = date::current_date();
+            vector<double> averaging_times;
+            for (const string& averaging_date : averaging_dates) {
+                int year, month, day;
+                sscanf(averaging_date.c_str(), "%d-%d-%d", &year, &month, &day);
+                date averagingDate(day, month, year);
+                if (!averagingDate.valid()) {
+                    res.status = 400;
+                    res.set_content("Invalid averaging date " + averaging_date, "text/plain");
+                    return;
+                }
+                averaging_times.push_back(startingDate.years_until(averagingDate, request.day_count));
+            }
+            averaging_steps = ho_lee_exercise_steps(averaging_times, request.time_step);
+        }
+
+        HoLeePricingReport pricing_report;
+        HoLeeMonteCarloResult simulation;
+        double price = price_asian_option_on_bond_using_ho_lee_monte_carlo(request.initial.get(),
+                                                                           request.delta,
+                                                                           request.pi,
+                                                                           request.bond_cflow_times,
+                                                                           request.bond_cflows,
+                                                                           option_type == "put" ? BondOptionType::Put : BondOptionType::Call,
+                                                                           K,
+                                                                           request.time_to_expiry,
+                                                                           averaging_steps,
+                                                                           request.market_times,
+                                                                           request.market_prices,
+                                                                           monte_carlo,
+                                                                           &simulation,
+                                                                           calibration_settings,
+                                                                           &calibrations,
+                                                                           &pricing_report,
+                                                                           request.time_step);
+
+        json response;
+        response["price"] = price;
+        response["standard_error"] = simulation.standard_error;
+        response["paths"] = simulation.paths;
+        response["european_price"] = simulation.control_price;
+        response["control_beta"] = simulation.control_beta;
+        if (request.diagnostics) {
+            response["diagnostics"] = diagnosticsJson(request, pricing_report);
+            response["diagnostics"]["timings_ms"]["simulation"] = simulation.simulation_ms;
+        }
+
         res.set_content(response.dump(), "application/json");
     });
 